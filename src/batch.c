@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "batch.h"
+#include "message.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "touch.h"
+#include "device.h"
+#include "print.h"
+#include "misc.h"
+
+/* Type of device an operation acts on, DEV_NONE for delays */
+static device_t batch_op_device(batch_op_t *op)
+{
+    switch (op->type)
+    {
+        case BATCH_KBD_KEY:
+        case BATCH_KBD_KEYDOWN:
+        case BATCH_KBD_KEYUP:
+            return DEV_KEYBOARD;
+
+        case BATCH_MOUSE_MOVE:
+        case BATCH_MOUSE_BUTTON:
+        case BATCH_MOUSE_BUTTONDOWN:
+        case BATCH_MOUSE_BUTTONUP:
+        case BATCH_MOUSE_SCROLL:
+            return DEV_MOUSE;
+
+        case BATCH_TOUCH_TAP:
+            return DEV_TOUCH;
+
+        default:
+            return DEV_NONE;
+    }
+}
+
+/* Operations take two steps (phases). Operations holding a key, button or
+ * contact release it in the second phase after a delay. */
+static int batch_op_execute(batch_op_t *op, uint8_t device_id, uint32_t phase, uint32_t *delay)
+{
+    input_device_t *device = NULL;
+
+    /* Operations act on the devices with the id of the request */
+    switch (op->type)
+    {
+        case BATCH_KBD_KEY:
+        case BATCH_KBD_KEYDOWN:
+        case BATCH_KBD_KEYUP:
+        case BATCH_MOUSE_MOVE:
+        case BATCH_MOUSE_BUTTON:
+        case BATCH_MOUSE_BUTTONDOWN:
+        case BATCH_MOUSE_BUTTONUP:
+        case BATCH_MOUSE_SCROLL:
+        case BATCH_TOUCH_TAP:
+            device = device_lookup(batch_op_device(op), device_id);
+            break;
+
+        case BATCH_DELAY:
+            if (phase == 0)
+            {
+                *delay = op->arg[0];
+            }
+            return 0;
+
+        default:
+            warning_printf("Unknown batch operation %u\n", op->type);
+            return -1;
+    }
+
+    if (device == NULL)
+    {
+        warning_printf("No device with id %u for batch operation %u\n", device_id, op->type);
+        return -1;
+    }
+
+    if (phase == 1)
+    {
+        switch (op->type)
+        {
+            case BATCH_KBD_KEY:
+                keyboard_release(device, op->arg[0]);
+                break;
+
+            case BATCH_MOUSE_BUTTON:
+                mouse_release(device, op->arg[0]);
+                break;
+
+            case BATCH_TOUCH_TAP:
+                touch_up(device);
+                break;
+
+            default:
+                break;
+        }
+
+        return 0;
+    }
+
+    switch (op->type)
+    {
+        case BATCH_KBD_KEY:
+            keyboard_press(device, op->arg[0]);
+            *delay = device->type_delay;
+            break;
+
+        case BATCH_KBD_KEYDOWN:
+            keyboard_press(device, op->arg[0]);
+            break;
+
+        case BATCH_KBD_KEYUP:
+            keyboard_release(device, op->arg[0]);
+            break;
+
+        case BATCH_MOUSE_MOVE:
+            mouse_move(device, op->arg[0], op->arg[1]);
+            break;
+
+        case BATCH_MOUSE_BUTTON:
+            mouse_press(device, op->arg[0]);
+            *delay = 1;
+            break;
+
+        case BATCH_MOUSE_BUTTONDOWN:
+            mouse_press(device, op->arg[0]);
+            break;
+
+        case BATCH_MOUSE_BUTTONUP:
+            mouse_release(device, op->arg[0]);
+            break;
+
+        case BATCH_MOUSE_SCROLL:
+            mouse_scroll(device, op->arg[0]);
+            break;
+
+        case BATCH_TOUCH_TAP:
+            touch_down(device, op->arg[0], op->arg[1]);
+            *delay = op->arg[2];
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+int do_batch(input_device_t *device, void *message, uint32_t step, uint32_t *delay)
+{
+    message_header_t *header = message;
+    batch_op_t *ops = message + sizeof(message_header_t);
+    uint32_t count = header->payload_length / sizeof(batch_op_t);
+    uint32_t i = step / 2;
+
+    UNUSED(device);
+
+    if (header->payload_length % sizeof(batch_op_t))
+    {
+        warning_printf("Invalid payload length\n");
+        return -1;
+    }
+
+    if (step == 0)
+    {
+        debug_printf("Executing batch of %u operations\n", count);
+    }
+
+    if (i >= count)
+    {
+        return ACTION_DONE;
+    }
+
+    /* Execute operations in order, stop at first invalid operation */
+    if (batch_op_execute(&ops[i], header->device_id, step % 2, delay) < 0)
+    {
+        return -1;
+    }
+
+    return (((step % 2) == 0) || ((i + 1) < count)) ? ACTION_WAIT : ACTION_DONE;
+}
+
+/* Check operation before batch is queued. Delays and durations must not be
+ * negative. */
+static int batch_op_validate(const batch_op_t *op)
+{
+    switch (op->type)
+    {
+        case BATCH_KBD_KEY:
+        case BATCH_KBD_KEYDOWN:
+        case BATCH_KBD_KEYUP:
+        case BATCH_MOUSE_MOVE:
+        case BATCH_MOUSE_BUTTON:
+        case BATCH_MOUSE_BUTTONDOWN:
+        case BATCH_MOUSE_BUTTONUP:
+        case BATCH_MOUSE_SCROLL:
+            return 0;
+
+        case BATCH_TOUCH_TAP:
+            if ((op->arg[0] < 0) || (op->arg[1] < 0) || (op->arg[2] < 0))
+            {
+                warning_printf("Invalid tap of batch\n");
+                return -1;
+            }
+            return 0;
+
+        case BATCH_DELAY:
+            if (op->arg[0] < 0)
+            {
+                warning_printf("Invalid delay %d of batch\n", op->arg[0]);
+                return -1;
+            }
+            return 0;
+
+        default:
+            warning_printf("Unknown batch operation %u\n", op->type);
+            return -1;
+    }
+}
+
+/* Type of device targeted by first device operation of batch */
+static device_t batch_device(void *message)
+{
+    message_header_t *header = message;
+    batch_op_t *ops = message + sizeof(message_header_t);
+    uint32_t count = header->payload_length / sizeof(batch_op_t);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (batch_op_device(&ops[i]) != DEV_NONE)
+        {
+            return batch_op_device(&ops[i]);
+        }
+    }
+
+    return DEV_NONE;
+}
+
+/* A batch is queued as job of the device targeted by its first device
+ * operation. Operations on other devices are emitted by that job too, in
+ * batch order, but not ordered with requests queued for the other devices.
+ * A batch without device operations is rejected as delays are timed by a
+ * device. */
+void do_batch_submit(void *message)
+{
+    message_header_t *header = message;
+    batch_op_t *ops = message + sizeof(message_header_t);
+    uint32_t count = header->payload_length / sizeof(batch_op_t);
+    device_t device = batch_device(message);
+
+    if (header->payload_length == 0)
+    {
+        msg_send_rsp_ok();
+        return;
+    }
+
+    if (header->payload_length % sizeof(batch_op_t))
+    {
+        warning_printf("Invalid payload length\n");
+        msg_send_rsp_error();
+        return;
+    }
+
+    /* Reject batch up front if an operation is invalid or targets a device
+     * which is not online. A device stopped while the batch is queued still
+     * fails it when its operation is reached. */
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (batch_op_validate(&ops[i]) < 0)
+        {
+            msg_send_rsp_error();
+            return;
+        }
+
+        if ((batch_op_device(&ops[i]) != DEV_NONE) &&
+            (device_lookup(batch_op_device(&ops[i]), header->device_id) == NULL))
+        {
+            warning_printf("No device with id %u for batch operation %u\n",
+                           header->device_id, ops[i].type);
+            msg_send_rsp_error();
+            return;
+        }
+    }
+
+    /* Delays are timed by a device */
+    if (device == DEV_NONE)
+    {
+        warning_printf("No device operation in batch\n");
+        msg_send_rsp_error();
+        return;
+    }
+
+    device_submit(device, do_batch, message);
+}
+
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "device.h"
+
+typedef enum
+{
+    BATCH_KBD_KEY,          // arg[0]: key
+    BATCH_KBD_KEYDOWN,      // arg[0]: key
+    BATCH_KBD_KEYUP,        // arg[0]: key
+    BATCH_MOUSE_MOVE,       // arg[0]: x, arg[1]: y
+    BATCH_MOUSE_BUTTON,     // arg[0]: button
+    BATCH_MOUSE_BUTTONDOWN, // arg[0]: button
+    BATCH_MOUSE_BUTTONUP,   // arg[0]: button
+    BATCH_MOUSE_SCROLL,     // arg[0]: ticks
+    BATCH_TOUCH_TAP,        // arg[0]: x, arg[1]: y, arg[2]: duration (ms)
+    BATCH_DELAY,            // arg[0]: delay (ms)
+} batch_op_type_t;
+
+typedef struct __attribute__((__packed__))
+{
+    uint8_t type;
+    int32_t arg[3];
+} batch_op_t;
+
+typedef struct
+{
+    batch_op_t *ops;
+    uint32_t count;
+    uint32_t size;
+} batch_t;
+
+void batch_init(batch_t *batch);
+int batch_add(batch_t *batch, batch_op_type_t type, int32_t arg0, int32_t arg1, int32_t arg2);
+void batch_clear(batch_t *batch);
+void batch_free(batch_t *batch);
+int do_batch(input_device_t *device, void *message, uint32_t step, uint32_t *delay);
+void do_batch_submit(void *message);
+int do_batch_request(batch_t *batch);
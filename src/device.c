@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "device.h"
+#include "service.h"
+#include "uinput.h"
+#include "event.h"
+#include "message.h"
+#include "touch.h"
+#include "print.h"
+
+/* Device table indexed by type and id */
+static input_device_t device_table[DEV_ALL][DEVICE_ID_MAX];
+
+/* Get table entry of device whether online or not */
+input_device_t *device_entry(device_t type, unsigned int id)
+{
+    input_device_t *device;
+
+    if ((type >= DEV_ALL) || (id >= DEVICE_ID_MAX))
+    {
+        return NULL;
+    }
+
+    device = &device_table[type][id];
+    device->type = type;
+    device->id = id;
+
+    return device;
+}
+
+/* Get device if online */
+input_device_t *device_lookup(device_t type, unsigned int id)
+{
+    input_device_t *device = device_entry(type, id);
+
+    if ((device == NULL) || !device->online)
+    {
+        return NULL;
+    }
+
+    return device;
+}
+
+/* Get online device targeted by request. Responds with error if none. */
+input_device_t *device_from_request(device_t type, void *message)
+{
+    message_header_t *header = message;
+    input_device_t *device = device_lookup(type, header->device_id);
+
+    if (device == NULL)
+    {
+        warning_printf("No %s device with id %u\n", device_type_name(type), header->device_id);
+        msg_send_rsp_error();
+    }
+
+    return device;
+}
+
+/* Name of input device. The first device of a type keeps the plain name. */
+void device_name(const input_device_t *device, const char *base, char *name, size_t size)
+{
+    if (device->id == 0)
+    {
+        snprintf(name, size, "%s", base);
+    }
+    else
+    {
+        snprintf(name, size, "%s %u", base, device->id);
+    }
+}
+
+static void device_timer_expired(timer_entry_t *timer);
+
+void device_add(input_device_t *device, int fd)
+{
+    device->fd = fd;
+    device->jobs = NULL;
+    device->jobs_last = NULL;
+    device->job_count = 0;
+    timer_init(&device->timer, device_timer_expired, device);
+    device->online = true;
+
+    device_ref_count++;
+}
+
+/* Track keys and buttons pressed */
+void device_key_held(input_device_t *device, uint32_t code, bool held)
+{
+    if (code >= KEY_CNT)
+    {
+        return;
+    }
+
+    if (held)
+    {
+        device->keys_held[code / 64] |= (1ULL << (code % 64));
+    }
+    else
+    {
+        device->keys_held[code / 64] &= ~(1ULL << (code % 64));
+    }
+}
+
+/* Release all keys, buttons and touch contacts held, e.g. when a job is
+ * cancelled */
+void device_release(input_device_t *device)
+{
+    event_frame_t frame;
+
+    for (uint32_t code = 0; code < KEY_CNT; code++)
+    {
+        if (device->keys_held[code / 64] & (1ULL << (code % 64)))
+        {
+            debug_printf("Release held key %u\n", code);
+
+            event_frame_begin(&frame, device->fd, &device->commit_ns);
+            event_frame_add(&frame, EV_KEY, code, 0);
+            event_frame_commit(&frame);
+
+            device_key_held(device, code, false);
+        }
+    }
+
+    if (device->contact)
+    {
+        touch_up(device);
+    }
+}
+
+/* Remove job from queue of device and respond to it */
+static void device_job_finish(input_device_t *device, msg_job_t *job, job_state_t state)
+{
+    msg_job_t **link = &device->jobs;
+    msg_job_t *previous = NULL;
+
+    while (*link != job)
+    {
+        previous = *link;
+        link = &(*link)->queue_next;
+    }
+
+    *link = job->queue_next;
+    if (device->jobs_last == job)
+    {
+        device->jobs_last = previous;
+    }
+    device->job_count--;
+
+    msg_job_complete(job, state);
+}
+
+/* Release what a cancelled job holds. A batch may act on all devices with
+ * the id of the request. */
+static void device_job_release(input_device_t *device, msg_job_t *job)
+{
+    message_header_t *header = (message_header_t *) job->message;
+    input_device_t *other;
+
+    if (header->type != REQ_BATCH)
+    {
+        device_release(device);
+        return;
+    }
+
+    for (device_t type = DEV_KEYBOARD; type < DEV_ALL; type++)
+    {
+        other = device_lookup(type, header->device_id);
+        if (other != NULL)
+        {
+            device_release(other);
+        }
+    }
+}
+
+/* Perform steps of jobs of device until a step has to wait */
+static void device_run(input_device_t *device)
+{
+    device_action_t action;
+    msg_job_t *job;
+    uint32_t delay;
+    uint64_t now;
+    int status;
+
+    while ((job = device->jobs) != NULL)
+    {
+        if (job->cancel)
+        {
+            if (job->state == JOB_RUNNING)
+            {
+                device_job_release(device, job);
+            }
+            device_job_finish(device, job, JOB_CANCELLED);
+            continue;
+        }
+
+        /* Steps are due at absolute deadlines counted from start of job, so
+         * time spent performing steps does not add up. Steps falling
+         * behind are performed right away to catch up. */
+        if (job->step == 0)
+        {
+            device->deadline = event_time_now_ns();
+        }
+
+        job->state = JOB_RUNNING;
+
+        delay = 0;
+        action = (device_action_t) job->action;
+        status = action(device, job->message, job->step++, &delay);
+
+        if (status == ACTION_WAIT)
+        {
+            device->deadline += (uint64_t) delay * 1000000;
+
+            now = event_time_now_ns();
+            if (device->deadline > now)
+            {
+                timer_schedule(&device->timer, device->deadline);
+                return;
+            }
+            continue;
+        }
+
+        device_job_finish(device, job, (status < 0) ? JOB_FAILED : JOB_DONE);
+    }
+}
+
+static void device_timer_expired(timer_entry_t *timer)
+{
+    device_run(timer->data);
+}
+
+/* Queued jobs are dropped at once. The running job is stopped by the
+ * server loop right after the request cancelling it. */
+static void device_job_cancel(msg_job_t *job)
+{
+    input_device_t *device = job->owner;
+
+    if (job == device->jobs)
+    {
+        timer_schedule(&device->timer, 0);
+        return;
+    }
+
+    device_job_finish(device, job, JOB_CANCELLED);
+}
+
+/* Queue request as job of targeted device. Responds with error if there is
+ * no such device. Jobs of a device are performed in order. */
+void device_submit(device_t type, device_action_t action, void *message)
+{
+    input_device_t *device = device_from_request(type, message);
+    msg_job_t *job;
+
+    if (device == NULL)
+    {
+        return;
+    }
+
+    /* Stop reading requests of client until jobs complete */
+    if (device->job_count == DEVICE_JOBS_MAX)
+    {
+        msg_stall();
+        return;
+    }
+
+    job = msg_job_create(message, device, device_job_cancel);
+    if (job == NULL)
+    {
+        msg_send_rsp_error();
+        return;
+    }
+    job->action = (void (*)(void)) action;
+
+    if (device->jobs_last != NULL)
+    {
+        device->jobs_last->queue_next = job;
+    }
+    else
+    {
+        device->jobs = job;
+    }
+    device->jobs_last = job;
+    device->job_count++;
+
+    /* Start right away if device is idle */
+    if ((device->jobs == job) && !timer_scheduled(&device->timer))
+    {
+        device_run(device);
+    }
+}
+
+void device_destroy(input_device_t *device)
+{
+    if (!device->online)
+    {
+        return;
+    }
+
+    debug_printf("Destroying %s input device %u\n", device_type_name(device->type), device->id);
+
+    /* Cancel all jobs of device */
+    timer_cancel(&device->timer);
+    if ((device->jobs != NULL) && (device->jobs->state == JOB_RUNNING))
+    {
+        device_job_release(device, device->jobs);
+    }
+    while (device->jobs != NULL)
+    {
+        device_job_finish(device, device->jobs, JOB_CANCELLED);
+    }
+
+    uinput_destroy(device->fd, device->commit_ns);
+
+    device->fd = -1;
+    device->commit_ns = 0;
+    device->online = false;
+    memset(device->keys_held, 0, sizeof(device->keys_held));
+    device->contact = false;
+    device->sys_name[0] = 0;
+    free(device->type_buffer);
+    device->type_buffer = NULL;
+
+    device_ref_count--;
+}
+
+/* Destroy device(s). DEV_ALL and DEVICE_ID_ALL act as wildcards. */
+void devices_destroy(device_t type, unsigned int id)
+{
+    input_device_t *device;
+
+    for (device_t t = DEV_KEYBOARD; t < DEV_ALL; t++)
+    {
+        if ((type != DEV_ALL) && (type != t))
+        {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < DEVICE_ID_MAX; i++)
+        {
+            if ((id != DEVICE_ID_ALL) && (id != i))
+            {
+                continue;
+            }
+
+            device = device_lookup(t, i);
+            if (device != NULL)
+            {
+                device_destroy(device);
+            }
+        }
+    }
+}
+
+void devices_destroy_all(void)
+{
+    devices_destroy(DEV_ALL, DEVICE_ID_ALL);
+}
+
+const char *device_type_name(device_t type)
+{
+    switch (type)
+    {
+        case DEV_KEYBOARD:
+            return "kbd";
+        case DEV_MOUSE:
+            return "mouse";
+        case DEV_TOUCH:
+            return "touch";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/input-event-codes.h>
+#include "options.h"
+#include "misc.h"
+#include "timer.h"
+#include "message.h"
+#include "layout.h"
+
+/* Maximum number of devices of each type */
+#define DEVICE_ID_MAX 16
+
+/* Device id addressing all devices of a type */
+#define DEVICE_ID_ALL 0xff
+
+/* Maximum number of jobs queued for a device */
+#define DEVICE_JOBS_MAX 256
+
+/* Return values of device actions (see device_action_t) */
+#define ACTION_DONE 0
+#define ACTION_WAIT 1
+
+typedef struct
+{
+    device_t type;
+    uint8_t id;
+    bool online;
+    int fd;
+    char sys_name[SYS_NAME_LENGTH_MAX];
+    uint64_t commit_ns; // Time of last committed event frame (CLOCK_MONOTONIC, ns)
+
+    /* Keyboard configuration */
+    uint32_t type_delay;
+    uint32_t type_modifier; // Modifier held while typing string
+    const char *type_text;  // Text being typed
+    uint32_t type_length;   // Length of text available
+    uint32_t type_offset;   // Offset of character being typed
+    int type_fd;            // File rest of text is read from or -1
+    char *type_buffer;      // Text read from file
+    const layout_t *layout;
+
+    /* Mouse and touch configuration */
+    int x_max;
+    int y_max;
+    int slots;
+
+    /* Keys and buttons pressed */
+    uint64_t keys_held[(KEY_CNT + 63) / 64];
+
+    /* Touch state */
+    uint32_t tracking_id;
+    bool contact;
+
+    /* Jobs performing requests targeting device. The first job is running
+     * and the timer resumes it after a delay. */
+    msg_job_t *jobs;
+    msg_job_t *jobs_last;
+    unsigned int job_count;
+    timer_entry_t timer;
+    uint64_t deadline; // Due time of next step (CLOCK_MONOTONIC, ns)
+} input_device_t;
+
+/* Device action performed in steps by the server loop. Called with step 0,
+ * 1, 2, ... until it returns ACTION_DONE or a negative value on failure.
+ * After ACTION_WAIT the next step is performed *delay ms later. */
+typedef int (*device_action_t)(input_device_t *device, void *message, uint32_t step, uint32_t *delay);
+
+input_device_t *device_entry(device_t type, unsigned int id);
+input_device_t *device_lookup(device_t type, unsigned int id);
+input_device_t *device_from_request(device_t type, void *message);
+void device_name(const input_device_t *device, const char *base, char *name, size_t size);
+void device_add(input_device_t *device, int fd);
+void device_key_held(input_device_t *device, uint32_t code, bool held);
+void device_release(input_device_t *device);
+void device_submit(device_t type, device_action_t action, void *message);
+void device_destroy(input_device_t *device);
+void devices_destroy(device_t type, unsigned int id);
+void devices_destroy_all(void);
+const char *device_type_name(device_t type);
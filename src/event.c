@@ -23,25 +23,72 @@
 #include <linux/uinput.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include "event.h"
 #include "print.h"
 
-void emit(int fd, int type, int code, int val)
+uint64_t event_time_now_ns(void)
 {
-    struct input_event ie;
-    int status;
+    struct timespec ts;
 
-    ie.type = type;
-    ie.code = code;
-    ie.value = val;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void event_frame_begin(event_frame_t *frame, int fd, uint64_t *commit_ns)
+{
+    frame->fd = fd;
+    frame->commit_ns = commit_ns;
+    frame->count = 0;
+}
+
+void event_frame_add(event_frame_t *frame, int type, int code, int val)
+{
+    struct input_event *ie;
+
+    /* Always leave room for the terminating SYN_REPORT */
+    if (frame->count >= (EVENT_FRAME_MAX - 1))
+    {
+        warning_printf("Event frame full, dropping event\n");
+        return;
+    }
+
+    ie = &frame->events[frame->count++];
+    ie->type = type;
+    ie->code = code;
+    ie->value = val;
 
     /* timestamp values below are ignored */
-    ie.time.tv_sec = 0;
-    ie.time.tv_usec = 0;
+    ie->time.tv_sec = 0;
+    ie->time.tv_usec = 0;
+}
+
+int event_frame_commit(event_frame_t *frame)
+{
+    struct input_event *ie;
+    ssize_t status;
+
+    /* Terminate frame (slot reserved by event_frame_add()) */
+    ie = &frame->events[frame->count++];
+    ie->type = EV_SYN;
+    ie->code = SYN_REPORT;
+    ie->value = 0;
+    ie->time.tv_sec = 0;
+    ie->time.tv_usec = 0;
+
+    /* Hand all events of the frame to the kernel in one write */
+    status = write(frame->fd, frame->events, frame->count * sizeof(struct input_event));
+    frame->count = 0;
+
+    *frame->commit_ns = event_time_now_ns();
 
-    status = write(fd, &ie, sizeof(ie));
     if (status < 0)
     {
-        error_printf("Emit failed (%s)\n", strerror(errno));
+        status = -errno;
+        error_printf("Emit failed (%s)\n", strerror(-status));
+        return status;
     }
-}
 
+    return 0;
+}
@@ -20,4 +20,21 @@
 
 #pragma once
 
-void emit(int fd, int type, int code, int val);
+#include <stdint.h>
+#include <linux/input.h>
+
+/* Maximum number of events in one frame (including the SYN_REPORT) */
+#define EVENT_FRAME_MAX 16
+
+typedef struct
+{
+    int fd;
+    uint64_t *commit_ns; // Time of last commit to device (CLOCK_MONOTONIC, ns)
+    unsigned int count;
+    struct input_event events[EVENT_FRAME_MAX];
+} event_frame_t;
+
+void event_frame_begin(event_frame_t *frame, int fd, uint64_t *commit_ns);
+void event_frame_add(event_frame_t *frame, int type, int code, int val);
+int event_frame_commit(event_frame_t *frame);
+uint64_t event_time_now_ns(void);
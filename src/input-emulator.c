@@ -0,0 +1,396 @@
+/*
+ * input-emulator - a scriptable input emulator
+ *
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <wchar.h>
+#include "input-emulator.h"
+#include "message.h"
+#include "service.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "touch.h"
+#include "device.h"
+#include "batch.h"
+
+/* Batch being collected (see input_emulator_batch_begin()) */
+static batch_t batch;
+static bool batch_active = false;
+static unsigned int batch_device_id = 0;
+static unsigned int device_id = 0;
+
+static wchar_t *mbs_to_wcs(const char *string)
+{
+    wchar_t *wcs;
+    size_t length;
+
+    length = mbstowcs(NULL, string, 0);
+    if (length == (size_t) -1)
+    {
+        errno = EILSEQ;
+        return NULL;
+    }
+
+    wcs = calloc(length + 1, sizeof(wchar_t));
+    if (wcs == NULL)
+    {
+        return NULL;
+    }
+
+    mbstowcs(wcs, string, length + 1);
+
+    return wcs;
+}
+
+int input_emulator_instance(const char *name)
+{
+    return message_instance_select(name);
+}
+
+int input_emulator_open(void)
+{
+    return message_client_open();
+}
+
+void input_emulator_close(void)
+{
+    message_client_close();
+}
+
+void input_emulator_pipeline_enable(void)
+{
+    message_client_pipeline_enable();
+}
+
+int input_emulator_sync(void)
+{
+    message_sync_data_t sync;
+
+    return do_message_sync_request(&sync);
+}
+
+int input_emulator_select(unsigned int id)
+{
+    if ((id >= DEVICE_ID_MAX) && (id != DEVICE_ID_ALL))
+    {
+        return -EINVAL;
+    }
+
+    /* Operations of batch act on the same devices */
+    if (batch_active && (id != batch_device_id))
+    {
+        return -EBUSY;
+    }
+
+    message_client_device_select(id);
+    device_id = id;
+
+    return 0;
+}
+
+void input_emulator_async_enable(int enable)
+{
+    message_client_async_enable(enable != 0);
+}
+
+uint32_t input_emulator_job_id(void)
+{
+    return message_client_job_id();
+}
+
+int input_emulator_job_status(uint32_t id)
+{
+    job_state_t state;
+    int status;
+
+    status = do_message_job_status_request(id, &state);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    return state;
+}
+
+int input_emulator_job_wait(uint32_t id)
+{
+    job_state_t state;
+    int status;
+
+    status = do_message_job_wait_request(id, &state);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    return state;
+}
+
+int input_emulator_job_cancel(uint32_t id)
+{
+    return do_message_job_cancel_request(id);
+}
+
+int input_emulator_status(char *text, size_t size)
+{
+    if ((text == NULL) || (size == 0))
+    {
+        return -EINVAL;
+    }
+
+    return do_service_status_request(text, size);
+}
+
+int input_emulator_kbd_start(uint32_t type_delay)
+{
+    return do_keyboard_start_request(type_delay);
+}
+
+int input_emulator_kbd_layout(const char *name)
+{
+    if (name == NULL)
+    {
+        return -EINVAL;
+    }
+
+    if (batch_active)
+    {
+        return -EBUSY;
+    }
+
+    return do_keyboard_layout_request(name);
+}
+
+int input_emulator_kbd_stop(void)
+{
+    return do_service_stop_request(DEV_KEYBOARD);
+}
+
+int input_emulator_mouse_start(uint32_t x_max, uint32_t y_max)
+{
+    return do_mouse_start_request(x_max, y_max);
+}
+
+int input_emulator_mouse_stop(void)
+{
+    return do_service_stop_request(DEV_MOUSE);
+}
+
+int input_emulator_touch_start(uint32_t x_max, uint32_t y_max, uint8_t slots)
+{
+    return do_touch_start_request(x_max, y_max, slots);
+}
+
+int input_emulator_touch_stop(void)
+{
+    return do_service_stop_request(DEV_TOUCH);
+}
+
+int input_emulator_stop_all(void)
+{
+    return do_service_stop_request(DEV_ALL);
+}
+
+int input_emulator_key_lookup(const char *name, uint32_t *key)
+{
+    wchar_t *wcs;
+    int status;
+
+    wcs = mbs_to_wcs(name);
+    if (wcs == NULL)
+    {
+        return -errno;
+    }
+
+    status = wchar_or_alias_to_key(wcs, key);
+    free(wcs);
+
+    return (status < 0) ? -ENOENT : 0;
+}
+
+int input_emulator_kbd_key(uint32_t key)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_KBD_KEY, key, 0, 0);
+    }
+
+    return do_keyboard_key_request(key);
+}
+
+int input_emulator_kbd_keydown(uint32_t key)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_KBD_KEYDOWN, key, 0, 0);
+    }
+
+    return do_keyboard_keydown_request(key);
+}
+
+int input_emulator_kbd_keyup(uint32_t key)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_KBD_KEYUP, key, 0, 0);
+    }
+
+    return do_keyboard_keyup_request(key);
+}
+
+int input_emulator_kbd_type(const char *string)
+{
+    wchar_t *wcs;
+    int status;
+
+    if (batch_active)
+    {
+        return -EBUSY;
+    }
+
+    wcs = mbs_to_wcs(string);
+    if (wcs == NULL)
+    {
+        return -errno;
+    }
+
+    status = do_keyboard_type_request(wcs);
+    free(wcs);
+
+    return status;
+}
+
+int input_emulator_kbd_type_file(const char *path)
+{
+    if (batch_active)
+    {
+        return -EBUSY;
+    }
+
+    return do_keyboard_type_file_request(path);
+}
+
+int input_emulator_mouse_move(int32_t x, int32_t y)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_MOUSE_MOVE, x, y, 0);
+    }
+
+    return do_mouse_move_request(x, y);
+}
+
+int input_emulator_mouse_button(int button)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_MOUSE_BUTTON, button, 0, 0);
+    }
+
+    return do_mouse_click_request(button);
+}
+
+int input_emulator_mouse_buttondown(int button)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_MOUSE_BUTTONDOWN, button, 0, 0);
+    }
+
+    return do_mouse_down_request(button);
+}
+
+int input_emulator_mouse_buttonup(int button)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_MOUSE_BUTTONUP, button, 0, 0);
+    }
+
+    return do_mouse_up_request(button);
+}
+
+int input_emulator_mouse_scroll(int32_t ticks)
+{
+    if (batch_active)
+    {
+        return batch_add(&batch, BATCH_MOUSE_SCROLL, ticks, 0, 0);
+    }
+
+    return do_mouse_scroll_request(ticks);
+}
+
+int input_emulator_touch_tap(uint32_t x, uint32_t y, uint32_t duration)
+{
+    if (batch_active)
+    {
+        if ((x > INT32_MAX) || (y > INT32_MAX) || (duration > INT32_MAX))
+        {
+            return -EINVAL;
+        }
+        return batch_add(&batch, BATCH_TOUCH_TAP, x, y, duration);
+    }
+
+    return do_touch_tap_request(x, y, duration);
+}
+
+int input_emulator_batch_begin(void)
+{
+    if (batch_active)
+    {
+        return -EBUSY;
+    }
+
+    batch_clear(&batch);
+    batch_active = true;
+    batch_device_id = device_id;
+
+    return 0;
+}
+
+int input_emulator_batch_delay(uint32_t ms)
+{
+    if (!batch_active)
+    {
+        return -EINVAL;
+    }
+
+    if (ms > INT32_MAX)
+    {
+        return -EINVAL;
+    }
+
+    return batch_add(&batch, BATCH_DELAY, ms, 0, 0);
+}
+
+int input_emulator_batch_end(void)
+{
+    if (!batch_active)
+    {
+        return -EINVAL;
+    }
+
+    batch_active = false;
+
+    return do_batch_request(&batch);
+}
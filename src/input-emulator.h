@@ -0,0 +1,148 @@
+/*
+ * input-emulator - a scriptable input emulator
+ *
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Client API of libinput-emulator.
+ *
+ * Open a connection to a running input-emulator service once with
+ * input_emulator_open() and perform actions on its emulated devices with
+ * the functions below. Keys and buttons are Linux input event codes (see
+ * linux/input-event-codes.h).
+ *
+ * All functions return 0 on success and a negative errno value on failure.
+ * The API is not thread safe.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Only the API is exported by the library */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+/* Connection */
+
+/* Select named service instance before opening the connection. NULL
+ * selects the default instance. Without it the instance is taken from
+ * the INPUT_EMULATOR_INSTANCE environment variable. Names consist of at
+ * most 64 letters, digits, '-', '_' or '.' characters. */
+int input_emulator_instance(const char *name);
+int input_emulator_open(void);
+void input_emulator_close(void);
+
+/* Send requests without waiting for each to be acknowledged. Call
+ * input_emulator_sync() to wait for requests to be performed and to
+ * collect any errors (-EIO if one or more requests failed). */
+void input_emulator_pipeline_enable(void);
+int input_emulator_sync(void);
+
+/* Select id of device targeted by subsequent requests (default: 0). Stop
+ * requests with INPUT_EMULATOR_ID_ALL stop all devices of a type. Start
+ * requests create the device with the selected id. */
+#define INPUT_EMULATOR_ID_ALL 0xff
+int input_emulator_select(unsigned int id);
+
+/* Jobs. In asynchronous mode device actions return as soon as they are
+ * queued and the id of the job performing the action is available from
+ * input_emulator_job_id(). Jobs can then be polled, waited for and
+ * cancelled. Cancelled jobs release any keys, buttons and contacts they
+ * hold. Typing a long text is one job queued in parts. It returns once all
+ * parts are queued, which for very long texts waits for the first parts to
+ * be typed. input_emulator_job_status() and input_emulator_job_wait() return
+ * the job state or a negative errno value. */
+#define INPUT_EMULATOR_JOB_ALL 0
+#define INPUT_EMULATOR_JOB_QUEUED 0
+#define INPUT_EMULATOR_JOB_RUNNING 1
+#define INPUT_EMULATOR_JOB_DONE 2
+#define INPUT_EMULATOR_JOB_FAILED 3
+#define INPUT_EMULATOR_JOB_CANCELLED 4
+#define INPUT_EMULATOR_JOB_UNKNOWN 5
+void input_emulator_async_enable(int enable);
+uint32_t input_emulator_job_id(void);
+int input_emulator_job_status(uint32_t id);
+int input_emulator_job_wait(uint32_t id);
+int input_emulator_job_cancel(uint32_t id);
+
+/* Service */
+int input_emulator_status(char *text, size_t size);
+int input_emulator_kbd_start(uint32_t type_delay);
+int input_emulator_kbd_stop(void);
+int input_emulator_mouse_start(uint32_t x_max, uint32_t y_max);
+int input_emulator_mouse_stop(void);
+int input_emulator_touch_start(uint32_t x_max, uint32_t y_max, uint8_t slots);
+int input_emulator_touch_stop(void);
+int input_emulator_stop_all(void);
+
+/* Keyboard */
+int input_emulator_key_lookup(const char *name, uint32_t *key);
+int input_emulator_kbd_key(uint32_t key);
+int input_emulator_kbd_keydown(uint32_t key);
+int input_emulator_kbd_keyup(uint32_t key);
+
+/* Switch layout used for typing. Layouts are compiled layout files loaded
+ * by the service (see input-emulator(1)). */
+int input_emulator_kbd_layout(const char *name);
+
+/* The string is decoded using the current locale (see setlocale(3)) */
+int input_emulator_kbd_type(const char *string);
+
+/* Type UTF-8 text of regular file. The file is opened by the caller and
+ * read by the service. */
+int input_emulator_kbd_type_file(const char *path);
+
+/* Mouse */
+int input_emulator_mouse_move(int32_t x, int32_t y);
+int input_emulator_mouse_button(int button);
+int input_emulator_mouse_buttondown(int button);
+int input_emulator_mouse_buttonup(int button);
+int input_emulator_mouse_scroll(int32_t ticks);
+
+/* Touch */
+int input_emulator_touch_tap(uint32_t x, uint32_t y, uint32_t duration);
+
+/* Batches. Between input_emulator_batch_begin() and
+ * input_emulator_batch_end() the key, mouse and touch actions above are
+ * collected instead of being sent, as are delays added with
+ * input_emulator_batch_delay(). input_emulator_batch_end() sends them as a
+ * single request which the service performs in order. All operations act
+ * on the devices with the id selected at input_emulator_batch_begin().
+ * The batch is rejected as a whole if one of these devices is not online or
+ * if it holds delays only.
+ * Typing and layout changes are refused with -EBUSY while a batch is
+ * collected. */
+int input_emulator_batch_begin(void);
+int input_emulator_batch_delay(uint32_t ms);
+int input_emulator_batch_end(void);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,26 +22,39 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <wchar.h>
+#include "device.h"
+#include "keymap.h"
+#include "layout.h"
+
+#define KEYBOARD_TYPE_CHUNK_SIZE 4096 // Bytes of UTF-8 text per type request
+#define KEYBOARD_TYPE_CHUNKS_AHEAD 4  // Type requests sent ahead of response
 
 typedef struct
 {
     uint32_t type_delay;
 } keyboard_start_data_t;
 
-int keyboard_create(uint32_t type_delay);
-void keyboard_destroy(void);
-bool keyboard_online(void);
-const char* keyboard_sys_name(void);
-uint32_t keyboard_type_delay(void);
-void do_keyboard_keydown(void *message);
-void do_keyboard_keydown_request(uint32_t key);
-void do_keyboard_keyup(void *message);
-void do_keyboard_keyup_request(uint32_t key);
-void do_keyboard_key(void *message);
-void do_keyboard_key_request(uint32_t key);
-void do_keyboard_type(void *message);
-void do_keyboard_type_request(const wchar_t *wc_string);
+typedef struct
+{
+    char name[LAYOUT_NAME_LENGTH_MAX];
+} keyboard_layout_data_t;
+
+int keyboard_create(unsigned int id, uint32_t type_delay);
+void keyboard_press(input_device_t *kbd, uint32_t key);
+void keyboard_release(input_device_t *kbd, uint32_t key);
+int do_keyboard_keydown(input_device_t *kbd, void *message, uint32_t step, uint32_t *delay);
+int do_keyboard_keydown_request(uint32_t key);
+int do_keyboard_keyup(input_device_t *kbd, void *message, uint32_t step, uint32_t *delay);
+int do_keyboard_keyup_request(uint32_t key);
+int do_keyboard_key(input_device_t *kbd, void *message, uint32_t step, uint32_t *delay);
+int do_keyboard_key_request(uint32_t key);
+int do_keyboard_type(input_device_t *kbd, void *message, uint32_t step, uint32_t *delay);
+int do_keyboard_type_request(const wchar_t *wc_string);
+int do_keyboard_type_file(input_device_t *kbd, void *message, uint32_t step, uint32_t *delay);
+int do_keyboard_type_file_request(const char *path);
 void do_keyboard_start(void *message);
-void do_keyboard_start_request(uint32_t type_delay);
+int do_keyboard_start_request(uint32_t type_delay);
+int do_keyboard_layout(input_device_t *kbd, void *message, uint32_t step, uint32_t *delay);
+int do_keyboard_layout_request(const char *name);
 int wchar_to_key(wchar_t wc, uint32_t *key, uint32_t *modifier);
-void wchar_or_alias_to_key(wchar_t *wcs, uint32_t *key);
+int wchar_or_alias_to_key(const wchar_t *wcs, uint32_t *key);
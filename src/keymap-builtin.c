@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2022  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <linux/input-event-codes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <wchar.h>
+#include "keymap.h"
+
+#define SHIFT  (1 << 14)
+#define ALT_GR (1 << 13)
+
+/* Map list of supportd wchar values (incomplete) */
+static struct wchar_to_key_map_t
+{
+    wchar_t wchar;
+    uint32_t key;
+    uint32_t modifier;
+}
+wchar_to_key_map_dk[] =
+{
+    { 32, KEY_SPACE, 0}, // ' '
+    { 33, KEY_1, KEY_LEFTSHIFT}, // !
+    { 34, KEY_2, KEY_LEFTSHIFT}, // "
+    { 35, KEY_3, KEY_LEFTSHIFT}, // #
+    { 36, KEY_4, KEY_LEFTSHIFT}, // $
+    { 37, KEY_5, KEY_LEFTSHIFT}, // %
+    { 38, KEY_6, KEY_LEFTSHIFT}, // &
+    { 39, KEY_BACKSLASH, 0}, // '
+    { 40, KEY_8, KEY_LEFTSHIFT}, // (
+    { 41, KEY_9, KEY_LEFTSHIFT}, // )
+    { 42, KEY_BACKSLASH, KEY_LEFTSHIFT}, // *
+    { 43, KEY_MINUS, 0}, // +
+    { 44, KEY_COMMA, 0}, // ,
+    { 45, KEY_SLASH, 0}, // -
+    { 46, KEY_DOT, 0}, // .
+    { 47, KEY_7, KEY_LEFTSHIFT}, // /
+    { 48, KEY_0, 0}, // 0
+    { 49, KEY_1, 0}, // 1
+    { 50, KEY_2, 0}, // 2
+    { 51, KEY_3, 0}, // 3
+    { 52, KEY_4, 0}, // 4
+    { 53, KEY_5, 0}, // 5
+    { 54, KEY_6, 0}, // 6
+    { 55, KEY_7, 0}, // 7
+    { 56, KEY_8, 0}, // 8
+    { 57, KEY_9, 0}, // 9
+    { 58, KEY_DOT, KEY_LEFTSHIFT}, // :
+    { 59, KEY_SEMICOLON, 0}, // ;
+    { 60, KEY_102ND, 0}, // <
+    { 61, KEY_0, KEY_LEFTSHIFT}, // =
+    { 62, KEY_102ND, KEY_LEFTSHIFT}, // >
+    { 63, KEY_MINUS, KEY_LEFTSHIFT}, // ?
+    { 64, KEY_2, KEY_LEFTALT}, // @
+    { 65, KEY_A, KEY_LEFTSHIFT}, // A
+    { 66, KEY_B, KEY_LEFTSHIFT}, // B
+    { 67, KEY_C, KEY_LEFTSHIFT}, // C
+    { 68, KEY_D, KEY_LEFTSHIFT}, // D
+    { 69, KEY_E, KEY_LEFTSHIFT}, // E
+    { 70, KEY_F, KEY_LEFTSHIFT}, // F
+    { 71, KEY_G, KEY_LEFTSHIFT}, // G
+    { 72, KEY_H, KEY_LEFTSHIFT}, // H
+    { 73, KEY_I, KEY_LEFTSHIFT}, // I
+    { 74, KEY_J, KEY_LEFTSHIFT}, // J
+    { 75, KEY_K, KEY_LEFTSHIFT}, // K
+    { 76, KEY_L, KEY_LEFTSHIFT}, // L
+    { 77, KEY_M, KEY_LEFTSHIFT}, // M
+    { 78, KEY_N, KEY_LEFTSHIFT}, // N
+    { 79, KEY_O, KEY_LEFTSHIFT}, // O
+    { 80, KEY_P, KEY_LEFTSHIFT}, // P
+    { 81, KEY_Q, KEY_LEFTSHIFT}, // Q
+    { 82, KEY_R, KEY_LEFTSHIFT}, // R
+    { 83, KEY_S, KEY_LEFTSHIFT}, // S
+    { 84, KEY_T, KEY_LEFTSHIFT}, // T
+    { 85, KEY_U, KEY_LEFTSHIFT}, // U
+    { 86, KEY_V, KEY_LEFTSHIFT}, // V
+    { 87, KEY_W, KEY_LEFTSHIFT}, // W
+    { 88, KEY_X, KEY_LEFTSHIFT}, // X
+    { 89, KEY_Y, KEY_LEFTSHIFT}, // Y
+    { 90, KEY_Z, KEY_LEFTSHIFT}, // Z
+    { 91, KEY_8, KEY_RIGHTALT}, // [
+    { 92, KEY_102ND, KEY_LEFTALT}, // '\'
+    { 93, KEY_9, KEY_LEFTALT}, // ]
+    { 94, KEY_RIGHTBRACE, KEY_LEFTSHIFT}, // ^
+    { 95, KEY_SLASH, KEY_LEFTSHIFT}, // _
+    { 96, KEY_EQUAL, KEY_LEFTSHIFT}, // `
+    { 97, KEY_A, 0}, // a
+    { 98, KEY_B, 0}, // b
+    { 99, KEY_C, 0}, // c
+    { 100, KEY_D, 0}, // d
+    { 101, KEY_E, 0}, // e
+    { 102, KEY_F, 0}, // f
+    { 103, KEY_G, 0}, // g
+    { 104, KEY_H, 0}, // h
+    { 105, KEY_I, 0}, // i
+    { 106, KEY_J, 0}, // j
+    { 107, KEY_K, 0}, // k
+    { 108, KEY_L, 0}, // l
+    { 109, KEY_M, 0}, // m
+    { 110, KEY_N, 0}, // n
+    { 111, KEY_O, 0}, // o
+    { 112, KEY_P, 0}, // p
+    { 113, KEY_Q, 0}, // q
+    { 114, KEY_R, 0}, // r
+    { 115, KEY_S, 0}, // s
+    { 116, KEY_T, 0}, // t
+    { 117, KEY_U, 0}, // u
+    { 118, KEY_V, 0}, // v
+    { 119, KEY_W, 0}, // w
+    { 120, KEY_X, 0}, // x
+    { 121, KEY_Y, 0}, // y
+    { 122, KEY_Z, 0}, // z
+    { 123, KEY_7, KEY_RIGHTALT}, // {
+    { 124, KEY_EQUAL, KEY_RIGHTALT}, // |
+    { 125, KEY_7, KEY_RIGHTALT}, // }
+    { 126, KEY_RIGHTBRACE, KEY_RIGHTALT}, // ~
+
+    { 180, KEY_EQUAL, 0}, // `
+
+    { 197, KEY_LEFTBRACE, KEY_LEFTSHIFT}, // Å
+    { 198, KEY_SEMICOLON, KEY_LEFTSHIFT}, // Æ
+    { 216, KEY_APOSTROPHE, KEY_LEFTSHIFT}, // Ø
+    { 229, KEY_LEFTBRACE, 0}, // å
+    { 230, KEY_SEMICOLON, 0}, // æ
+    { 248, KEY_APOSTROPHE, 0}, // ø
+
+    { 0, 0, 0}, // End of list
+};
+
+/* Compiled from wchar_to_key_map_dk[] on first use */
+static keymap_t keymap_dk;
+static bool keymap_dk_compiled = false;
+
+static void keymap_dk_compile(void)
+{
+    int i = 0;
+
+    keymap_init(&keymap_dk);
+
+    while (wchar_to_key_map_dk[i].wchar != 0)
+    {
+        keymap_add(&keymap_dk,
+                   wchar_to_key_map_dk[i].wchar,
+                   wchar_to_key_map_dk[i].key,
+                   wchar_to_key_map_dk[i].modifier);
+        i++;
+    }
+
+    keymap_dk_compiled = true;
+}
+
+/* Built in DK layout, used if no compiled DK layout is installed */
+const keymap_t *keymap_builtin(void)
+{
+    if (!keymap_dk_compiled)
+    {
+        keymap_dk_compile();
+    }
+
+    return &keymap_dk;
+}
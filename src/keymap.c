@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "keymap.h"
+
+static inline uint32_t keymap_hash(uint32_t wc)
+{
+    /* Fibonacci hashing */
+    return (wc * 2654435761u) & (KEYMAP_HASH_SIZE - 1);
+}
+
+void keymap_init(keymap_t *keymap)
+{
+    memset(keymap, 0, sizeof(*keymap));
+}
+
+/* Add mapping of wide character to key and modifier. The first mapping
+ * added for a character wins. */
+int keymap_add(keymap_t *keymap, wchar_t wc, uint32_t key, uint32_t modifier)
+{
+    uint32_t i;
+
+    if ((wc <= 0) || (key == 0) || (key > UINT16_MAX) || (modifier > UINT16_MAX))
+    {
+        return -EINVAL;
+    }
+
+    if (wc < KEYMAP_DIRECT_SIZE)
+    {
+        if (keymap->direct[wc].key == 0)
+        {
+            keymap->direct[wc].key = key;
+            keymap->direct[wc].modifier = modifier;
+        }
+        return 0;
+    }
+
+    /* Keep at least one slot free so lookups of unmapped characters end */
+    if (keymap->hash_count >= KEYMAP_HASH_SIZE - 1)
+    {
+        return -ENOSPC;
+    }
+
+    /* Open addressing with linear probing */
+    for (i = keymap_hash(wc); keymap->hash[i].wchar != 0; i = (i + 1) & (KEYMAP_HASH_SIZE - 1))
+    {
+        if (keymap->hash[i].wchar == (uint32_t) wc)
+        {
+            return 0;
+        }
+    }
+
+    keymap->hash[i].wchar = wc;
+    keymap->hash[i].value.key = key;
+    keymap->hash[i].value.modifier = modifier;
+    keymap->hash_count++;
+
+    return 0;
+}
+
+int keymap_lookup(const keymap_t *keymap, wchar_t wc, uint32_t *key, uint32_t *modifier)
+{
+    const keymap_key_t *value = NULL;
+    uint32_t i;
+
+    if (wc <= 0)
+    {
+        return -1;
+    }
+
+    if (wc < KEYMAP_DIRECT_SIZE)
+    {
+        value = &keymap->direct[wc];
+    }
+    else
+    {
+        for (i = keymap_hash(wc); keymap->hash[i].wchar != 0; i = (i + 1) & (KEYMAP_HASH_SIZE - 1))
+        {
+            if (keymap->hash[i].wchar == (uint32_t) wc)
+            {
+                value = &keymap->hash[i].value;
+                break;
+            }
+        }
+    }
+
+    if ((value == NULL) || (value->key == 0))
+    {
+        return -1;
+    }
+
+    *key = value->key;
+    *modifier = value->modifier;
+
+    return 0;
+}
+
+/* Write keymap to file to be mapped with keymap_map() */
+int keymap_save(const keymap_t *keymap, const char *path)
+{
+    keymap_file_t file;
+    FILE *fp;
+    size_t count;
+
+    memset(&file, 0, sizeof(file));
+    file.magic = KEYMAP_FILE_MAGIC;
+    file.version = KEYMAP_FILE_VERSION;
+    file.size = sizeof(file);
+    file.keymap = *keymap;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return -errno;
+    }
+
+    count = fwrite(&file, sizeof(file), 1, fp);
+    if ((fclose(fp) != 0) || (count != 1))
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/* Map compiled keymap file read-only. The mapping is kept for the lifetime
+ * of the process. */
+int keymap_map(const char *path, const keymap_t **keymap)
+{
+    const keymap_file_t *file;
+    struct stat st;
+    bool end = false;
+    int status;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+
+    if (fstat(fd, &st) < 0)
+    {
+        status = -errno;
+        close(fd);
+        return status;
+    }
+
+    if (st.st_size != sizeof(keymap_file_t))
+    {
+        close(fd);
+        return -EINVAL;
+    }
+
+    file = mmap(NULL, sizeof(keymap_file_t), PROT_READ, MAP_PRIVATE, fd, 0);
+    status = -errno;
+    close(fd);
+    if (file == MAP_FAILED)
+    {
+        return status;
+    }
+
+    /* Lookups of unmapped characters rely on a free hash slot */
+    for (uint32_t i = 0; i < KEYMAP_HASH_SIZE; i++)
+    {
+        if (file->keymap.hash[i].wchar == 0)
+        {
+            end = true;
+            break;
+        }
+    }
+
+    if ((file->magic != KEYMAP_FILE_MAGIC) || (file->version != KEYMAP_FILE_VERSION) ||
+        (file->size != sizeof(keymap_file_t)) || !end)
+    {
+        munmap((void *) file, sizeof(keymap_file_t));
+        return -EINVAL;
+    }
+
+    *keymap = &file->keymap;
+
+    return 0;
+}
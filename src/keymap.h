@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <wchar.h>
+
+/* Characters below this value are looked up by direct index */
+#define KEYMAP_DIRECT_SIZE 256
+
+/* Number of hash slots for characters outside the direct range (power of 2) */
+#define KEYMAP_HASH_SIZE 512
+
+typedef struct
+{
+    uint16_t key;
+    uint16_t modifier;
+} keymap_key_t;
+
+typedef struct
+{
+    uint32_t wchar;
+    keymap_key_t value;
+} keymap_slot_t;
+
+/* Compiled character to key map. Contains no pointers so that it can be
+ * copied or mapped as a whole. A key value of 0 (KEY_RESERVED) marks an
+ * unused entry. */
+typedef struct
+{
+    keymap_key_t direct[KEYMAP_DIRECT_SIZE];
+    keymap_slot_t hash[KEYMAP_HASH_SIZE];
+    uint32_t hash_count;
+} keymap_t;
+
+/* Compiled keymap file written by input-emulator-layout and mapped as is by
+ * the service. Uses host byte order. */
+#define KEYMAP_FILE_MAGIC   0x4d4b4549 // "IEKM"
+#define KEYMAP_FILE_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // Size of file
+    uint32_t reserved;
+    keymap_t keymap;
+} keymap_file_t;
+
+void keymap_init(keymap_t *keymap);
+int keymap_add(keymap_t *keymap, wchar_t wc, uint32_t key, uint32_t modifier);
+int keymap_lookup(const keymap_t *keymap, wchar_t wc, uint32_t *key, uint32_t *modifier);
+int keymap_save(const keymap_t *keymap, const char *path);
+int keymap_map(const char *path, const keymap_t **keymap);
+const keymap_t *keymap_builtin(void);
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+#
+# Generate table of key names for keyname_lookup()
+#
+# Usage: keyname-table.py <output> <compiler> [<compiler arguments>]
+#
+# Collects all KEY_* and BTN_* codes defined by linux/input-event-codes.h, as
+# seen by the compiler, plus short aliases. Names are placed in an open
+# addressed hash table (linear probing) using the same case-insensitive hash
+# as keyname.c. The keyboard enables all KEY_* codes of the table.
+#
+
+import re
+import subprocess
+import sys
+
+# Short names accepted in addition to the KEY_* and BTN_* names
+ALIASES = [
+    ('alt', 'KEY_LEFTALT'),
+    ('altgr', 'KEY_RIGHTALT'),
+    ('backspace', 'KEY_BACKSPACE'),
+    ('capslock', 'KEY_CAPSLOCK'),
+    ('compose', 'KEY_COMPOSE'),
+    ('ctrl', 'KEY_LEFTCTRL'),
+    ('delete', 'KEY_DELETE'),
+    ('down', 'KEY_DOWN'),
+    ('end', 'KEY_END'),
+    ('enter', 'KEY_ENTER'),
+    ('esc', 'KEY_ESC'),
+    ('f1', 'KEY_F1'),
+    ('f2', 'KEY_F2'),
+    ('f3', 'KEY_F3'),
+    ('f4', 'KEY_F4'),
+    ('f5', 'KEY_F5'),
+    ('f6', 'KEY_F6'),
+    ('f7', 'KEY_F7'),
+    ('f8', 'KEY_F8'),
+    ('f9', 'KEY_F9'),
+    ('f10', 'KEY_F10'),
+    ('f11', 'KEY_F11'),
+    ('f12', 'KEY_F12'),
+    ('f13', 'KEY_F13'),
+    ('f14', 'KEY_F14'),
+    ('f15', 'KEY_F15'),
+    ('f16', 'KEY_F16'),
+    ('f17', 'KEY_F17'),
+    ('f18', 'KEY_F18'),
+    ('f19', 'KEY_F19'),
+    ('f20', 'KEY_F20'),
+    ('help', 'KEY_HELP'),
+    ('home', 'KEY_HOME'),
+    ('left', 'KEY_LEFT'),
+    ('meta', 'KEY_LEFTMETA'),
+    ('playpause', 'KEY_PLAYPAUSE'),
+    ('pgdn', 'KEY_PAGEDOWN'),
+    ('pgup', 'KEY_PAGEUP'),
+    ('right', 'KEY_RIGHT'),
+    ('shift', 'KEY_LEFTSHIFT'),
+    ('space', 'KEY_SPACE'),
+    ('stopcd', 'KEY_STOPCD'),
+    ('tab', 'KEY_TAB'),
+    ('up', 'KEY_UP'),
+]
+
+# Names which are not keys
+EXCLUDE = ['KEY_RESERVED', 'KEY_MAX', 'KEY_CNT', 'BTN_MISC', 'BTN_MOUSE',
+           'BTN_JOYSTICK', 'BTN_GAMEPAD', 'BTN_DIGI', 'BTN_WHEEL',
+           'BTN_TRIGGER_HAPPY']
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+
+
+def keyname_hash(name):
+    """FNV-1a of lower case name (see keyname_hash() in keyname.c)"""
+    h = FNV_OFFSET
+    for c in name.lower().encode('ascii'):
+        h = ((h ^ c) * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def codes(compiler):
+    """Return dict of KEY_* and BTN_* names to codes"""
+    output = subprocess.run(compiler + ['-E', '-dM', '-x', 'c', '-include',
+                                        'linux/input-event-codes.h', '/dev/null'],
+                            stdout=subprocess.PIPE, check=True,
+                            universal_newlines=True).stdout
+
+    defines = {}
+    for line in output.splitlines():
+        m = re.match(r'#define ((?:KEY|BTN)_\w+) (\w+)$', line)
+        if m:
+            defines[m.group(1)] = m.group(2)
+
+    result = {}
+    for name in defines:
+        value = defines[name]
+        # Resolve names defined as other names
+        while value in defines:
+            value = defines[value]
+        try:
+            result[name] = int(value, 0)
+        except ValueError:
+            continue
+
+    for name in EXCLUDE:
+        result.pop(name, None)
+
+    return result
+
+
+def main():
+    output = sys.argv[1]
+    names = codes(sys.argv[2:])
+
+    for alias, key in ALIASES:
+        names[alias] = names[key]
+
+    size = 1
+    while size < 2 * len(names):
+        size *= 2
+
+    table = [None] * size
+    for name in sorted(names):
+        i = keyname_hash(name) & (size - 1)
+        while table[i] is not None:
+            i = (i + 1) & (size - 1)
+        table[i] = name
+
+    with open(output, 'w') as f:
+        f.write('/* Generated by keyname-table.py - do not edit */\n\n')
+        f.write('#include "keyname.h"\n\n')
+        f.write('const uint32_t keyname_table_size = %d;\n\n' % size)
+        f.write('const keyname_t keyname_table[%d] =\n{\n' % size)
+        for i, name in enumerate(table):
+            if name is not None:
+                f.write('    [%d] = { "%s", %d },\n' % (i, name, names[name]))
+        f.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
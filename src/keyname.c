@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <strings.h>
+#include "keyname.h"
+
+/* FNV-1a of lower case name. Must match keyname_hash() of
+ * keyname-table.py. */
+static uint32_t keyname_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name != 0; name++)
+    {
+        hash ^= (uint8_t) tolower((unsigned char) *name);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* Look up key code by name (KEY_*, BTN_* or alias), ignoring case */
+int keyname_lookup(const char *name, uint32_t *key)
+{
+    uint32_t mask = keyname_table_size - 1;
+
+    for (uint32_t i = keyname_hash(name) & mask; keyname_table[i].name != NULL; i = (i + 1) & mask)
+    {
+        if (strcasecmp(keyname_table[i].name, name) == 0)
+        {
+            *key = keyname_table[i].key;
+            return 0;
+        }
+    }
+
+    return -1;
+}
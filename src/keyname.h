@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define KEYNAME_LENGTH_MAX 64
+
+/* Entry of key name table generated by keyname-table.py. Empty entries have
+ * no name. */
+typedef struct
+{
+    const char *name;
+    uint16_t key;
+} keyname_t;
+
+extern const keyname_t keyname_table[];
+extern const uint32_t keyname_table_size;
+
+int keyname_lookup(const char *name, uint32_t *key);
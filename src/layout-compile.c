@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Layout compiler
+ *
+ * Compiles a text layout description into a keymap file which the service
+ * maps at startup. Each line of a layout maps a character to the key and
+ * optional modifier typing it:
+ *
+ *   # <character> <key> [<modifier>]
+ *   a       KEY_A
+ *   A       KEY_A  KEY_LEFTSHIFT
+ *   U+0023  KEY_3  KEY_LEFTSHIFT
+ *
+ * Characters are given as UTF-8 or as U+<hex>. Keys are given by name or
+ * code. The first mapping of a character wins.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/input-event-codes.h>
+#include "keymap.h"
+#include "keyname.h"
+#include "print.h"
+#include "misc.h"
+
+#define LINE_LENGTH_MAX 256
+
+static int key_parse(const char *text, uint32_t *key)
+{
+    char *end;
+
+    if (keyname_lookup(text, key) == 0)
+    {
+        return 0;
+    }
+
+    /* Key code */
+    errno = 0;
+    *key = strtoul(text, &end, 0);
+    if ((errno != 0) || (end == text) || (*end != 0) || (*key == 0) || (*key > KEY_MAX))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Decode character given as single UTF-8 character or U+<hex> */
+static int wchar_parse(const char *text, uint32_t *wc)
+{
+    size_t length = strlen(text);
+    char *end;
+
+    if ((length > 2) && ((text[0] == 'U') || (text[0] == 'u')) && (text[1] == '+'))
+    {
+        errno = 0;
+        *wc = strtoul(text + 2, &end, 16);
+        if ((errno != 0) || (*end != 0) || (*wc == 0) || (*wc > 0x10ffff))
+        {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (utf8_decode(text, length, wc) != (int) length)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int layout_compile(FILE *fp, const char *path, keymap_t *keymap)
+{
+    char line[LINE_LENGTH_MAX];
+    char *character, *key_text, *modifier_text, *extra;
+    uint32_t wc, key, modifier;
+    int line_number = 0;
+    int status;
+
+    keymap_init(keymap);
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line_number++;
+
+        if (strchr(line, '\n') == NULL && !feof(fp))
+        {
+            error_printf("%s:%d: Line too long\n", path, line_number);
+            return -1;
+        }
+
+        /* Skip comments and empty lines */
+        character = strtok(line, " \t\r\n");
+        if ((character == NULL) || (character[0] == '#'))
+        {
+            continue;
+        }
+
+        key_text = strtok(NULL, " \t\r\n");
+        modifier_text = strtok(NULL, " \t\r\n");
+        extra = strtok(NULL, " \t\r\n");
+
+        if ((key_text == NULL) || ((extra != NULL) && (extra[0] != '#')))
+        {
+            error_printf("%s:%d: Expected <character> <key> [<modifier>]\n", path, line_number);
+            return -1;
+        }
+
+        if (wchar_parse(character, &wc) < 0)
+        {
+            error_printf("%s:%d: Invalid character '%s'\n", path, line_number, character);
+            return -1;
+        }
+
+        if (key_parse(key_text, &key) < 0)
+        {
+            error_printf("%s:%d: Invalid key '%s'\n", path, line_number, key_text);
+            return -1;
+        }
+
+        modifier = 0;
+        if ((modifier_text != NULL) && (modifier_text[0] != '#') &&
+            (key_parse(modifier_text, &modifier) < 0))
+        {
+            error_printf("%s:%d: Invalid modifier '%s'\n", path, line_number, modifier_text);
+            return -1;
+        }
+
+        status = keymap_add(keymap, wc, key, modifier);
+        if (status < 0)
+        {
+            error_printf("%s:%d: Could not add character (%s)\n", path, line_number, strerror(-status));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    keymap_t keymap;
+    FILE *fp;
+    int status;
+
+    if (argc != 3)
+    {
+        printf("Usage: input-emulator-layout <layout> <output>\n");
+        printf("\n");
+        printf("Compile text layout description into keymap file.\n");
+        return EXIT_FAILURE;
+    }
+
+    fp = fopen(argv[1], "r");
+    if (fp == NULL)
+    {
+        error_printf("Could not open %s (%s)\n", argv[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    status = layout_compile(fp, argv[1], &keymap);
+    fclose(fp);
+    if (status < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    status = keymap_save(&keymap, argv[2]);
+    if (status < 0)
+    {
+        error_printf("Could not write %s (%s)\n", argv[2], strerror(-status));
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "config.h"
+#include "layout.h"
+#include "keyboard.h"
+#include "print.h"
+
+/* Layouts loaded so far. Keymaps stay mapped so that switching layout of a
+ * keyboard is a pointer swap. */
+static layout_t layouts[LAYOUTS_MAX];
+static int layout_count = 0;
+
+static const layout_t *layout_selected = NULL;
+
+static bool layout_name_valid(const char *name)
+{
+    size_t length = strlen(name);
+
+    if ((length == 0) || (length >= LAYOUT_NAME_LENGTH_MAX))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = name[i];
+
+        if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+              ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_')))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Find layout by name, loading its compiled keymap on first use. Returns
+ * NULL if not found. */
+const layout_t *layout_get(const char *name)
+{
+    const char *directory = getenv(LAYOUT_PATH_ENV);
+    const keymap_t *keymap;
+    char path[4096];
+    layout_t *layout;
+    int status;
+
+    if (!layout_name_valid(name))
+    {
+        warning_printf("Invalid layout name '%s'\n", name);
+        return NULL;
+    }
+
+    for (int i = 0; i < layout_count; i++)
+    {
+        if (strcmp(layouts[i].name, name) == 0)
+        {
+            return &layouts[i];
+        }
+    }
+
+    if (layout_count == LAYOUTS_MAX)
+    {
+        warning_printf("Too many layouts loaded\n");
+        return NULL;
+    }
+
+    if ((directory == NULL) || (directory[0] == 0))
+    {
+        directory = LAYOUT_DIR;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s.bin", directory, name);
+
+    status = keymap_map(path, &keymap);
+    if ((status == -ENOENT) && (strcmp(name, LAYOUT_DEFAULT) == 0))
+    {
+        /* Fall back to built in layout */
+        keymap = keymap_builtin();
+    }
+    else if (status < 0)
+    {
+        warning_printf("Could not load layout %s (%s)\n", path, strerror(-status));
+        return NULL;
+    }
+
+    debug_printf("Loaded layout %s\n", name);
+
+    layout = &layouts[layout_count++];
+    strcpy(layout->name, name);
+    layout->keymap = keymap;
+
+    return layout;
+}
+
+/* Select layout of keyboards created. NULL selects the default layout. */
+int layout_default_select(const char *name)
+{
+    const layout_t *layout = layout_get(name ? name : LAYOUT_DEFAULT);
+
+    if (layout == NULL)
+    {
+        return -1;
+    }
+
+    layout_selected = layout;
+
+    return 0;
+}
+
+const layout_t *layout_default(void)
+{
+    if (layout_selected == NULL)
+    {
+        layout_default_select(NULL);
+    }
+
+    return layout_selected;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "keymap.h"
+
+/* Layout used when none is selected. Built in if no compiled file exists. */
+#define LAYOUT_DEFAULT "dk"
+
+/* Environment variable overriding directory of compiled layouts */
+#define LAYOUT_PATH_ENV "INPUT_EMULATOR_LAYOUT_PATH"
+
+#define LAYOUT_NAME_LENGTH_MAX 32
+
+/* Maximum number of layouts loaded at a time */
+#define LAYOUTS_MAX 64
+
+typedef struct
+{
+    char name[LAYOUT_NAME_LENGTH_MAX];
+    const keymap_t *keymap;
+} layout_t;
+
+const layout_t *layout_get(const char *name);
+int layout_default_select(const char *name);
+const layout_t *layout_default(void);
@@ -26,7 +26,9 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <locale.h>
+#include <pthread.h>
 #include "signals.h"
 #include "service.h"
 #include "message.h"
@@ -36,15 +38,46 @@
 #include "mouse.h"
 #include "event.h"
 #include "print.h"
-
-void handle_message(void)
+#include "batch.h"
+#include "script.h"
+#include "input-emulator.h"
+#include "device.h"
+#include "timer.h"
+#include "layout.h"
+
+void handle_message(void *message)
 {
-    void *message = NULL;
-    message_header_t *header;
+    message_header_t *header = message;
 
-    /* Receive message (blocking) */
-    msg_receive(&message);
-    header = message;
+    /* Device actions are queued as jobs of the targeted device. Other
+     * requests wait for actions of the client to be performed. */
+    switch (header->type)
+    {
+        case REQ_KBD_KEY:
+        case REQ_KBD_KEYDOWN:
+        case REQ_KBD_KEYUP:
+        case REQ_KBD_TYPE:
+        case REQ_KBD_TYPE_FILE:
+        case REQ_KBD_LAYOUT:
+        case REQ_MOUSE_MOVE:
+        case REQ_MOUSE_BUTTON:
+        case REQ_MOUSE_BUTTONDOWN:
+        case REQ_MOUSE_BUTTONUP:
+        case REQ_MOUSE_SCROLL:
+        case REQ_TOUCH_TAP:
+        case REQ_BATCH:
+        case REQ_JOB_STATUS:
+        case REQ_JOB_WAIT:
+        case REQ_JOB_CANCEL:
+            break;
+
+        default:
+            if (msg_barrier())
+            {
+                return;
+            }
+            break;
+    }
 
     /* Handle incoming message request */
     switch (header->type)
@@ -54,19 +87,27 @@ void handle_message(void)
             break;
 
         case REQ_KBD_KEY:
-            do_keyboard_key(message);
+            device_submit(DEV_KEYBOARD, do_keyboard_key, message);
             break;
 
         case REQ_KBD_KEYDOWN:
-            do_keyboard_keydown(message);
+            device_submit(DEV_KEYBOARD, do_keyboard_keydown, message);
             break;
 
         case REQ_KBD_KEYUP:
-            do_keyboard_keyup(message);
+            device_submit(DEV_KEYBOARD, do_keyboard_keyup, message);
             break;
 
         case REQ_KBD_TYPE:
-            do_keyboard_type(message);
+            device_submit(DEV_KEYBOARD, do_keyboard_type, message);
+            break;
+
+        case REQ_KBD_TYPE_FILE:
+            device_submit(DEV_KEYBOARD, do_keyboard_type_file, message);
+            break;
+
+        case REQ_KBD_LAYOUT:
+            device_submit(DEV_KEYBOARD, do_keyboard_layout, message);
             break;
 
         case REQ_MOUSE_START:
@@ -74,23 +115,23 @@ void handle_message(void)
             break;
 
         case REQ_MOUSE_MOVE:
-            do_mouse_move(message);
+            device_submit(DEV_MOUSE, do_mouse_move, message);
             break;
 
         case REQ_MOUSE_BUTTON:
-            do_mouse_click(message);
+            device_submit(DEV_MOUSE, do_mouse_click, message);
             break;
 
         case REQ_MOUSE_BUTTONDOWN:
-            do_mouse_down(message);
+            device_submit(DEV_MOUSE, do_mouse_down, message);
             break;
 
         case REQ_MOUSE_BUTTONUP:
-            do_mouse_up(message);
+            device_submit(DEV_MOUSE, do_mouse_up, message);
             break;
 
         case REQ_MOUSE_SCROLL:
-            do_mouse_scroll(message);
+            device_submit(DEV_MOUSE, do_mouse_scroll, message);
             break;
 
         case REQ_TOUCH_START:
@@ -98,7 +139,7 @@ void handle_message(void)
             break;
 
         case REQ_TOUCH_TAP:
-            do_touch_tap(message);
+            device_submit(DEV_TOUCH, do_touch_tap, message);
             break;
 
         case REQ_STATUS:
@@ -116,142 +157,180 @@ void handle_message(void)
             }
             break;
 
-        default:
+        case REQ_BATCH:
+            do_batch_submit(message);
             break;
-    }
 
-    /* Destroy message */
-    msg_destroy(message);
-}
+        case REQ_SYNC:
+            do_message_sync(message);
+            break;
 
-int main(int argc, char *argv[])
-{
-    /* Set default locale */
-    setlocale(LC_ALL, "");
+        case REQ_JOB_STATUS:
+            do_message_job_status(message);
+            break;
 
-    /* Parse options */
-    options_parse(argc, argv);
+        case REQ_JOB_WAIT:
+            do_message_job_wait(message);
+            break;
 
-    /* Check if service is running on non-start commands */
-    if (option.command != CMD_START)
-    {
-        // Check for running daemon/service
-        if (!service_running())
-        {
-            printf("Please start service using the 'input-emulator start <device>' command\n");
-            return -1;
-        }
+        case REQ_JOB_CANCEL:
+            do_message_job_cancel(message);
+            break;
 
-        /* Open message queue (client) */
-        message_client_open();
-        atexit(message_client_close);
+        default:
+            warning_printf("Unknown request type %u\n", header->type);
+            msg_send_rsp_error();
+            break;
     }
+}
 
-    /* Handle command */
-    switch (option.command)
+typedef struct
+{
+    device_t device;
+    unsigned int id;
+    pthread_t thread;
+    bool started;
+    int status;
+} device_create_job_t;
+
+static void *device_create_thread(void *arg)
+{
+    device_create_job_t *job = arg;
+
+    switch (job->device)
     {
-        case CMD_START:
+        case DEV_KEYBOARD:
+            job->status = keyboard_create(job->id, option.type_delay);
+            break;
 
-            if (service_running())
-            {
-                /* Server already running so we will act as client */
+        case DEV_MOUSE:
+            job->status = mouse_create(job->id, option.x_max, option.y_max);
+            break;
 
-                /* Open message queue (client) */
-                message_client_open();
-                atexit(message_client_close);
+        case DEV_TOUCH:
+            job->status = touch_create(job->id, option.x_max, option.y_max, option.slots);
+            break;
 
-                switch (option.device)
-                {
-                    case DEV_KEYBOARD:
-                        do_keyboard_start_request(option.type_delay);
-                        break;
+        default:
+            job->status = -1;
+            break;
+    }
 
-                    case DEV_MOUSE:
-                        do_mouse_start_request(option.x_max, option.y_max);
-                        break;
+    return NULL;
+}
 
-                    case DEV_TOUCH:
-                        do_touch_start_request(option.x_max, option.y_max, option.slots);
-                        break;
+/* Create devices with ids 0..count-1 of each type concurrently, each on its
+ * own thread, as creation is mostly waiting for the kernel and userspace to
+ * pick up the device */
+static int devices_create(unsigned int devices, unsigned int count)
+{
+    device_create_job_t jobs[DEV_ALL * DEVICE_ID_MAX];
+    unsigned int job_count = 0;
+    int status = 0;
 
-                    case DEV_ALL:
-                    case DEV_NONE:
-                        break;
-                }
-                return 0;
-            }
-            else
-            {
-                printf("Starting input-emulator service...\n");
-            }
+    for (device_t type = DEV_KEYBOARD; type < DEV_ALL; type++)
+    {
+        if ((devices & DEVICE_BIT(type)) == 0)
+        {
+            continue;
+        }
 
-            /* Run in background */
-            if (option.daemonize)
-            {
-                daemonize();
-            }
+        for (unsigned int id = 0; (id < count) && (id < DEVICE_ID_MAX); id++)
+        {
+            device_create_job_t *job = &jobs[job_count++];
 
-            /* Install signal handlers */
-            signal_handlers_install();
+            job->device = type;
+            job->id = id;
+            job->started = false;
+            job->status = 0;
+        }
+    }
 
-            switch (option.device)
-            {
-                case DEV_KEYBOARD:
-                    /* Initilize keyboard input event device */
-                    if (keyboard_create(option.type_delay) == 0)
-                    {
-                        atexit(keyboard_destroy);
-                    }
-                    break;
+    /* Devices are destroyed at exit, also if only some were created */
+    atexit(devices_destroy_all);
 
-                case DEV_MOUSE:
-                    /* Initilize mouse input event device */
-                    if (mouse_create(option.x_max, option.y_max) == 0)
-                    {
-                        atexit(mouse_destroy);
-                    }
-                    break;
+    for (unsigned int i = 0; i < job_count; i++)
+    {
+        if (pthread_create(&jobs[i].thread, NULL, device_create_thread, &jobs[i]) == 0)
+        {
+            jobs[i].started = true;
+        }
+        else
+        {
+            /* Create in this thread instead */
+            device_create_thread(&jobs[i]);
+        }
+    }
 
-                case DEV_TOUCH:
-                    /* Initilize touch input event device */
-                    if (touch_create(option.x_max, option.y_max, option.slots) == 0)
-                    {
-                        atexit(touch_destroy);
-                    }
-                    break;
+    for (unsigned int i = 0; i < job_count; i++)
+    {
+        if (jobs[i].started)
+        {
+            pthread_join(jobs[i].thread, NULL);
+        }
 
-                case DEV_ALL:
-                case DEV_NONE:
-                    break;
-            }
+        if (jobs[i].status < 0)
+        {
+            error_printf("Failed to create %s device %u\n", device_type_name(jobs[i].device), jobs[i].id);
+            status = -1;
+        }
+    }
 
-            /* Set up message queue */
-            message_server_open();
-            atexit(message_server_close);
+    return status;
+}
 
-            /* Enter command handling loop */
-            message_server_listen(handle_message);
+void handle_command(void)
+{
+    char status_text[STATUS_TEXT_LENGTH_MAX];
+    int status = 0;
 
-            break;
+    /* Actions target device 0 and stop targets all devices by default */
+    if (option.id >= 0)
+    {
+        status = input_emulator_select(option.id);
+    }
+    else
+    {
+        status = input_emulator_select((option.command == CMD_STOP) ? INPUT_EMULATOR_ID_ALL : 0);
+    }
+    if (status == -EBUSY)
+    {
+        error_printf("Operations of batch must target the same device id\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Print job id instead of waiting for action */
+    input_emulator_async_enable(option.async);
 
+    /* Handle client command */
+    switch (option.command)
+    {
         case CMD_KBD:
 
             switch (option.kbd_action)
             {
                 case KBD_KEY:
-                    do_keyboard_key_request(option.key);
+                    status = input_emulator_kbd_key(option.key);
                     break;
 
                 case KBD_KEYDOWN:
-                    do_keyboard_keydown_request(option.key);
+                    status = input_emulator_kbd_keydown(option.key);
                     break;
 
                 case KBD_KEYUP:
-                    do_keyboard_keyup_request(option.key);
+                    status = input_emulator_kbd_keyup(option.key);
                     break;
 
                 case KBD_TYPE:
-                    do_keyboard_type_request(option.wc_string);
+                    status = input_emulator_kbd_type(option.string);
+                    break;
+
+                case KBD_TYPE_FILE:
+                    status = input_emulator_kbd_type_file(option.string);
+                    break;
+
+                case KBD_LAYOUT:
+                    status = input_emulator_kbd_layout(option.layout);
                     break;
 
                 case KBD_NONE:
@@ -264,23 +343,23 @@ int main(int argc, char *argv[])
             switch (option.mouse_action)
             {
                 case MOUSE_MOVE:
-                    do_mouse_move_request(option.x, option.y);
+                    status = input_emulator_mouse_move(option.x, option.y);
                     break;
 
                 case MOUSE_BUTTON:
-                    do_mouse_click_request(option.button);
+                    status = input_emulator_mouse_button(option.button);
                     break;
 
                 case MOUSE_BUTTONDOWN:
-                    do_mouse_down_request(option.button);
+                    status = input_emulator_mouse_buttondown(option.button);
                     break;
 
                 case MOUSE_BUTTONUP:
-                    do_mouse_up_request(option.button);
+                    status = input_emulator_mouse_buttonup(option.button);
                     break;
 
                 case MOUSE_SCROLL:
-                    do_mouse_scroll_request(option.ticks);
+                    status = input_emulator_mouse_scroll(option.ticks);
                     break;
 
                 case MOUSE_NONE:
@@ -293,7 +372,7 @@ int main(int argc, char *argv[])
             switch (option.touch_action)
             {
                 case TOUCH_TAP:
-                    do_touch_tap_request(option.x, option.y, option.duration);
+                    status = input_emulator_touch_tap(option.x, option.y, option.duration);
                     break;
 
                 case TOUCH_NONE:
@@ -302,34 +381,248 @@ int main(int argc, char *argv[])
             break;
 
         case CMD_STATUS:
-            do_service_status_request();
+            status = input_emulator_status(status_text, sizeof(status_text));
+            if (status == 0)
+            {
+                printf("%s", status_text);
+            }
             break;
 
         case CMD_STOP:
             switch (option.device)
             {
                 case DEV_KEYBOARD:
-                    do_service_stop_request(DEV_KEYBOARD);
+                    status = input_emulator_kbd_stop();
                     break;
 
                 case DEV_MOUSE:
-                    do_service_stop_request(DEV_MOUSE);
+                    status = input_emulator_mouse_stop();
                     break;
 
                 case DEV_TOUCH:
-                    do_service_stop_request(DEV_TOUCH);
+                    status = input_emulator_touch_stop();
                     break;
 
                 case DEV_ALL:
-                    do_service_stop_request(DEV_ALL);
+                    status = input_emulator_stop_all();
                     break;
 
-
                 case DEV_NONE:
                     break;
             }
+            break;
+
+        case CMD_JOB:
+            switch (option.job_action)
+            {
+                case JOB_ACTION_STATUS:
+                    status = input_emulator_job_status(option.job_id);
+                    break;
+
+                case JOB_ACTION_WAIT:
+                    status = input_emulator_job_wait(option.job_id);
+                    break;
+
+                case JOB_ACTION_CANCEL:
+                    status = input_emulator_job_cancel(option.job_id);
+                    break;
+
+                case JOB_ACTION_NONE:
+                    break;
+            }
+
+            if ((status >= 0) && (option.job_action != JOB_ACTION_CANCEL))
+            {
+                printf("%s\n", msg_job_state_name(status));
+
+                /* Waiting succeeds only if job was performed */
+                if ((option.job_action == JOB_ACTION_WAIT) && (status != JOB_DONE))
+                {
+                    status = -1;
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if ((status >= 0) && option.async && (input_emulator_job_id() != 0))
+    {
+        printf("%u\n", input_emulator_job_id());
+    }
+
+    if (status == -EBUSY)
+    {
+        error_printf("Action not possible in batch\n");
+    }
+
+    if (status < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int status = 0;
+
+    /* Set default locale */
+    setlocale(LC_ALL, "");
+
+    /* Parse options */
+    options_parse(argc, argv);
+
+    /* Select service instance */
+    if (option.instance == NULL)
+    {
+        option.instance = getenv(MSG_INSTANCE_ENV);
+    }
+    if (message_instance_select(option.instance) < 0)
+    {
+        error_printf("Invalid instance name '%s'\n", option.instance);
+        return EXIT_FAILURE;
+    }
+
+    /* Check if service is running on non-start commands */
+    if (option.command != CMD_START)
+    {
+        // Check for running daemon/service
+        if (!service_running())
+        {
+            if (message_instance()[0] != 0)
+            {
+                printf("Please start service using the 'input-emulator --instance %s start <device>' command\n", message_instance());
+            }
+            else
+            {
+                printf("Please start service using the 'input-emulator start <device>' command\n");
+            }
+            return -1;
+        }
+
+        /* Open message queue (client) */
+        if (input_emulator_open() < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        atexit(input_emulator_close);
+    }
+
+    /* Handle command */
+    switch (option.command)
+    {
+        case CMD_START:
+
+            if (!message_server_activated() && service_running())
+            {
+                /* Server already running so we will act as client */
+
+                /* Open message queue (client) */
+                if (input_emulator_open() < 0)
+                {
+                    return EXIT_FAILURE;
+                }
+                atexit(input_emulator_close);
+
+                /* Request all devices at once and wait for them */
+                input_emulator_pipeline_enable();
+
+                for (unsigned int id = 0; (id < option.count) && (status == 0); id++)
+                {
+                    status = input_emulator_select(id);
+
+                    if ((status == 0) && (option.devices & DEVICE_BIT(DEV_KEYBOARD)))
+                    {
+                        status = input_emulator_kbd_start(option.type_delay);
+
+                        if ((status == 0) && (option.layout != NULL))
+                        {
+                            status = input_emulator_kbd_layout(option.layout);
+                        }
+                    }
+
+                    if ((status == 0) && (option.devices & DEVICE_BIT(DEV_MOUSE)))
+                    {
+                        status = input_emulator_mouse_start(option.x_max, option.y_max);
+                    }
+
+                    if ((status == 0) && (option.devices & DEVICE_BIT(DEV_TOUCH)))
+                    {
+                        status = input_emulator_touch_start(option.x_max, option.y_max, option.slots);
+                    }
+                }
+
+                if (status == 0)
+                {
+                    status = input_emulator_sync();
+                }
+                return (status < 0) ? EXIT_FAILURE : 0;
+            }
+            else
+            {
+                printf("Starting input-emulator service...\n");
+            }
+
+            /* Run in background (unless started by service manager) */
+            if (option.daemonize && !message_server_activated())
+            {
+                daemonize();
+            }
+
+            /* Install signal handlers */
+            signal_handlers_install();
+
+            /* Set up message queue. Done before creating devices so that
+               early clients can connect and wait for them. */
+            message_server_open(option.backlog);
+            atexit(message_server_close);
+
+            /* Delayed steps of device actions are timed by the server loop */
+            message_server_watch(timers_init(), timers_expire);
+            timers_spin_set((uint64_t) option.spin * 1000);
+
+            /* Keep event delivery latency bounded on a loaded host. Done
+               after daemonizing as memory locks are not inherited by
+               fork(). */
+            if (option.cpu >= 0)
+            {
+                service_cpu_set(option.cpu);
+            }
+            if (option.realtime)
+            {
+                service_realtime_enable();
+            }
+
+            /* Load layout of keyboards */
+            if (layout_default_select(option.layout) < 0)
+            {
+                return EXIT_FAILURE;
+            }
+
+            /* Initialize input event devices */
+            if (devices_create(option.devices, option.count) < 0)
+            {
+                return EXIT_FAILURE;
+            }
+
+            /* Service is ready, let parent or service manager know */
+            service_ready();
+
+            /* Enter command handling loop */
+            message_server_listen(handle_message);
+
+            break;
+
+        case CMD_RUN:
+            if (script_run(option.script, handle_command) < 0)
+            {
+                return EXIT_FAILURE;
+            }
+            break;
 
         default:
+            handle_command();
             break;
     }
 
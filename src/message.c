@@ -18,11 +18,13 @@
  */
 
 #include <stdio.h>
+#include <ctype.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/un.h>
 #include <stdbool.h>
@@ -30,21 +32,220 @@
 #include <sys/file.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include "message.h"
 #include "print.h"
+#include "misc.h"
 
-#define MAX_CLIENTS 1
-#define MSG_SOCKET_NAME "input-emulator.socket"
+#define MSG_SOCKET_NAME "input-emulator"
+#define MSG_INSTANCE_LENGTH_MAX 64
+#define MSG_BUFFER_SIZE_MIN 4096
+#define MSG_EPOLL_EVENTS_MAX 32
+#define MSG_SEND_TIMEOUT_MS 1000
+#define MSG_LISTEN_FDS_START 3
+#define MSG_JOB_RESULTS_MAX 256
+#define MSG_JOB_SIZE_KEEP_MAX 65536 // Larger message storage is not reused
+#define MSG_FDS_MAX 8
+
+/* State of one end of a connection. Message buffers are owned by the
+ * connection and reused for every message so that the steady state
+ * request/response path does not allocate. */
+typedef struct msg_connection
+{
+    int fd;
+
+    /* Receive and transmit buffers (grow on demand, never shrink) */
+    char *rx_buffer;
+    uint32_t rx_size;
+    uint32_t rx_start;  // Offset of first unhandled byte (server side)
+    uint32_t rx_length; // Offset of end of received data (server side)
+    char *tx_buffer;
+    uint32_t tx_size;
+
+    /* Peer hung up or connection failed (server side) */
+    bool hangup;
+
+    /* Client side pipelining state */
+    bool pipeline;
+    uint32_t tx_seq;
+    uint8_t device_id;  // Target device of requests (client side)
+    bool async;         // Requests are performed as jobs (client side)
+    bool job_continue;  // Requests continue job of previous request (client side)
+    uint32_t job_id;    // Job id of last request (client side)
+
+    /* Server side state of the request being handled */
+    uint8_t rx_flags;
+    uint32_t rx_seq;
+    int rx_fd;          // File descriptor passed with request or -1
+    uint32_t job_id_continued; // Job continued by MSG_FLAG_JOB_CONTINUE
+    uint32_t error_count;
+    uint32_t error_seq;
+
+    /* File descriptors received but not yet taken by their requests */
+    int rx_fds[MSG_FDS_MAX];
+    uint32_t rx_fd_count;
+
+    /* Requests queued as jobs of devices and not yet completed */
+    uint32_t jobs_pending;
+
+    /* Request can not be handled yet - retried when a job completes */
+    bool stalled;
+
+    /* Connection is in epoll set (server side) */
+    bool polled;
+} msg_connection_t;
+
+/* Jobs not yet completed and final state of recently completed jobs */
+static msg_job_t *jobs_active = NULL;
+static msg_job_t *jobs_free = NULL;
+static message_job_data_t job_results[MSG_JOB_RESULTS_MAX];
+static uint32_t job_id_last = 0;
 
 static int srv_sockfd;
-static int new_srv_sockfd;
-static int cli_sockfd;
-static int *sockfd = &new_srv_sockfd;
+static int msg_epoll_fd = -1;
+static msg_connection_t client_connection = { .fd = -1 };
+static msg_connection_t *connection = NULL;
+
+/* Additional file descriptor watched by server loop */
+static int watch_fd = -1;
+static void (*watch_callback)(void) = NULL;
+
+/* Connected clients (server side) */
+static msg_connection_t **connections = NULL;
+static int connection_count = 0;
+
+/* Stalled requests resumed since start of pass of server loop */
+static bool connections_resumed = false;
+
+static char *msg_buffer_reserve(char **buffer, uint32_t *size, uint32_t length)
+{
+    char *new_buffer;
+    uint32_t new_size;
+
+    if (length <= *size)
+    {
+        return *buffer;
+    }
+
+    new_size = *size ? *size : MSG_BUFFER_SIZE_MIN;
+    while (new_size < length)
+    {
+        if (new_size > (UINT32_MAX / 2))
+        {
+            error_printf("Message buffer of %u bytes too large\n", length);
+            return NULL;
+        }
+        new_size *= 2;
+    }
+
+    new_buffer = realloc(*buffer, new_size);
+    if (new_buffer == NULL)
+    {
+        error_printf("realloc() failed (%s)\n", strerror(errno));
+        return NULL;
+    }
+
+    *buffer = new_buffer;
+    *size = new_size;
+
+    return new_buffer;
+}
+
+static char msg_instance[MSG_INSTANCE_LENGTH_MAX + 1];
+static bool msg_instance_set = false;
+
+static int msg_instance_validate(const char *name)
+{
+    size_t length = strlen(name);
+
+    if ((length == 0) || (length > MSG_INSTANCE_LENGTH_MAX))
+    {
+        return -EINVAL;
+    }
+
+    /* Keep names usable in socket unit files and file names */
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!isalnum((unsigned char) name[i]) && (strchr("-_.", name[i]) == NULL))
+        {
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+/* Select service instance. NULL or an empty name selects the default
+ * instance. Must be called before opening the server or client. */
+int message_instance_select(const char *name)
+{
+    if ((name == NULL) || (name[0] == 0))
+    {
+        msg_instance[0] = 0;
+        msg_instance_set = true;
+        return 0;
+    }
+
+    if (msg_instance_validate(name) < 0)
+    {
+        return -EINVAL;
+    }
+
+    strcpy(msg_instance, name);
+    msg_instance_set = true;
+
+    return 0;
+}
+
+/* Name of selected instance, taken from the environment unless selected
+ * explicitly. Returns empty string for the default instance. */
+const char *message_instance(void)
+{
+    const char *name;
+
+    if (!msg_instance_set)
+    {
+        name = getenv(MSG_INSTANCE_ENV);
+        if ((name != NULL) && (message_instance_select(name) < 0))
+        {
+            warning_printf("Ignoring invalid %s '%s'\n", MSG_INSTANCE_ENV, name);
+            message_instance_select(NULL);
+        }
+        msg_instance_set = true;
+    }
+
+    return msg_instance;
+}
+
+/* Abstract socket address. The address length covers the name only, as
+ * done by service managers (e.g. ListenStream=@input-emulator.socket).
+ * Named instances use @input-emulator-<name>.socket. */
+static socklen_t msg_socket_address(struct sockaddr_un *addr)
+{
+    const char *instance = message_instance();
+    int length;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (instance[0] != 0)
+    {
+        length = sprintf(addr->sun_path + 1, "%s-%s.socket", MSG_SOCKET_NAME, instance);
+    }
+    else
+    {
+        length = sprintf(addr->sun_path + 1, "%s.socket", MSG_SOCKET_NAME);
+    }
+
+    return offsetof(struct sockaddr_un, sun_path) + 1 + length;
+}
 
 bool message_server_running(void)
 {
     int r;
     struct sockaddr_un serv_addr;
+    socklen_t addr_length;
     int sockfd;
     bool in_use_status = false;
 
@@ -57,12 +258,10 @@ bool message_server_running(void)
     }
 
     /* Initialize socket structure */
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    serv_addr.sun_family = AF_UNIX;
-    strcpy(serv_addr.sun_path + 1, MSG_SOCKET_NAME); // Abstract socket
+    addr_length = msg_socket_address(&serv_addr);
 
     /* Bind the host address using bind() call.*/
-    r = bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
+    r = bind(sockfd, (struct sockaddr *) &serv_addr, addr_length);
     if (r < 0)
     {
         if (errno == EADDRINUSE)
@@ -85,17 +284,74 @@ bool message_server_running(void)
 
 void message_client_mode_enable(void)
 {
-    sockfd = &cli_sockfd;
+    connection = &client_connection;
+}
+
+/* Number of listening sockets passed by service manager (LISTEN_FDS
+ * protocol) or 0 if not socket activated */
+int message_server_activated(void)
+{
+    const char *listen_pid = getenv("LISTEN_PID");
+    const char *listen_fds = getenv("LISTEN_FDS");
+
+    if ((listen_pid == NULL) || (listen_fds == NULL))
+    {
+        return 0;
+    }
+
+    if (strtol(listen_pid, NULL, 10) != getpid())
+    {
+        return 0;
+    }
+
+    return atoi(listen_fds) > 0 ? atoi(listen_fds) : 0;
+}
+
+static void message_server_adopt(int count)
+{
+    struct stat st;
+
+    if (count > 1)
+    {
+        warning_printf("Received %d sockets, only using the first\n", count);
+    }
+
+    srv_sockfd = MSG_LISTEN_FDS_START;
+
+    if ((fstat(srv_sockfd, &st) < 0) || !S_ISSOCK(st.st_mode))
+    {
+        error_printf("Passed file descriptor %d is not a socket\n", srv_sockfd);
+        exit(EXIT_FAILURE);
+    }
+
+    fcntl(srv_sockfd, F_SETFD, FD_CLOEXEC);
+    fcntl(srv_sockfd, F_SETFL, fcntl(srv_sockfd, F_GETFL) | O_NONBLOCK);
+
+    /* Do not pass on to any children */
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
 }
 
-void message_server_open(void)
+void message_server_open(int backlog)
 {
     debug_printf("Server opening message socket\n");
 
     struct sockaddr_un srv_addr;
+    socklen_t addr_length;
+    int count;
 
     debug_printf("Starting message server..\n");
 
+    /* Use already bound and listening socket if socket activated */
+    count = message_server_activated();
+    if (count > 0)
+    {
+        debug_printf("Using socket passed by service manager\n");
+        message_server_adopt(count);
+        return;
+    }
+
     /* Create UNIX file socket */
     srv_sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (srv_sockfd < 0)
@@ -105,222 +361,1381 @@ void message_server_open(void)
     }
 
     /* Initialize socket structure */
-    bzero((char *) &srv_addr, sizeof(srv_addr));
-    srv_addr.sun_family = AF_UNIX;
-    strcpy(srv_addr.sun_path + 1, MSG_SOCKET_NAME); // Use abstract socket
+    addr_length = msg_socket_address(&srv_addr);
 
-    /* Bind the host address using bind() call (creates socket file) */
-    if (bind(srv_sockfd, (struct sockaddr *) &srv_addr, sizeof(srv_addr)) < 0)
+    /* Bind the host address using bind() call */
+    if (bind(srv_sockfd, (struct sockaddr *) &srv_addr, addr_length) < 0)
     {
         error_printf("On binding (%s)\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
+
+    /* Listen for incoming connections */
+    if (listen(srv_sockfd, backlog) < 0)
+    {
+        error_printf("On listen (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fcntl(srv_sockfd, F_SETFL, fcntl(srv_sockfd, F_GETFL) | O_NONBLOCK);
 }
 
-void message_server_listen(void (*callback)(void))
+/* Add connection to or remove it from epoll set */
+static void msg_connection_poll(msg_connection_t *c, bool enable)
 {
-    struct sockaddr_un cli_addr;
-    socklen_t cli_len;
-
-    /* Listen and sleep until incoming connection */
-    listen(srv_sockfd, MAX_CLIENTS);
-    cli_len = sizeof(cli_addr);
+    struct epoll_event event;
 
-    while (1)
+    if (enable == c->polled)
     {
-        /* Block until a new connection is available */
-        new_srv_sockfd = accept(srv_sockfd, (struct sockaddr *) &cli_addr, &cli_len);
-        if (new_srv_sockfd < 0)
-        {
-            error_printf("On accept (%s)\n", strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-
-        /* Do callback which will handle incoming request by reading/writing
-         * messages */
-        callback();
+        return;
+    }
 
-        /* Close connection when done handling incoming request */
-        close(new_srv_sockfd);
+    event.events = EPOLLIN;
+    event.data.ptr = c;
+    if (epoll_ctl(msg_epoll_fd, enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, c->fd, &event) < 0)
+    {
+        error_printf("epoll_ctl() failed (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
-}
 
-void message_server_close(void)
-{
-    close(srv_sockfd);
+    c->polled = enable;
 }
 
-void message_client_open(void)
+static void msg_connection_add(int fd)
 {
-    struct sockaddr_un srv_addr;
-
-    debug_printf("Starting socket client\n");
+    msg_connection_t **new_connections;
+    msg_connection_t *c;
 
-    /* Create a UNIX file socket */
-    cli_sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (cli_sockfd < 0)
+    c = calloc(1, sizeof(msg_connection_t));
+    new_connections = realloc(connections, (connection_count + 1) * sizeof(msg_connection_t *));
+    if ((c == NULL) || (new_connections == NULL))
     {
-        error_printf("Opening socket (%s)\n", strerror(errno));
+        error_printf("Out of memory (%s)\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
+    connections = new_connections;
+    connections[connection_count++] = c;
 
-    /* Initialize socket structure */
-    bzero((char *) &srv_addr, sizeof(srv_addr));
-    srv_addr.sun_family = AF_UNIX;
-    strcpy(srv_addr.sun_path + 1, MSG_SOCKET_NAME); // Use abstract socket
+    c->fd = fd;
+    c->rx_fd = -1;
 
-    /* Connect to the server */
-    if (connect(cli_sockfd, (struct sockaddr*)&srv_addr, sizeof(srv_addr)) < 0)
-    {
-        error_printf("Connect failure (%s)\n", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
+    msg_connection_poll(c, true);
 
-    message_client_mode_enable();
+    debug_printf("Client connected (%d clients)\n", connection_count);
 }
 
-void message_client_close(void)
+static void msg_connection_remove(int index)
 {
-    debug_printf("Closing socket client\n");
-    close(cli_sockfd);
+    msg_connection_t *c = connections[index];
+
+    msg_connection_poll(c, false);
+    close(c->fd);
+    for (uint32_t i = 0; i < c->rx_fd_count; i++)
+    {
+        close(c->rx_fds[i]);
+    }
+    if (c->rx_fd >= 0)
+    {
+        close(c->rx_fd);
+    }
+    free(c->rx_buffer);
+    free(c->tx_buffer);
+    free(c);
+
+    connections[index] = connections[--connection_count];
+
+    debug_printf("Client disconnected (%d clients)\n", connection_count);
 }
 
-int msg_create(
-        void **message,
-        message_type_t type,
-        void *payload,
-        uint32_t payload_length)
+static bool msg_connection_message_ready(msg_connection_t *c)
 {
     message_header_t *header;
-    char *payload_p;
+    uint32_t available = c->rx_length - c->rx_start;
 
-    // Allocate memory for message buffer
-    *message = malloc(sizeof(message_header_t) + payload_length);
-    if (*message == NULL)
+    if (available < sizeof(message_header_t))
     {
-        perror("Failed to allocate memory for message\n");
-        return -1;
+        return false;
     }
 
-    // Create message header
-    header = *message;
-    header->type = type;
-    header->payload_length = payload_length;
+    header = (message_header_t *) (c->rx_buffer + c->rx_start);
 
-    // Copy payload if any
-    if (payload_length > 0)
+    /* Oversized message is never handled (see msg_connection_oversized()) */
+    if (header->payload_length > MSG_PAYLOAD_MAX)
     {
-        payload_p = *message;
-        memcpy(payload_p + sizeof(message_header_t), payload, payload_length);
+        return false;
     }
 
-    return 0;
+    return available >= (sizeof(message_header_t) + header->payload_length);
 }
 
-void msg_destroy(void *message)
+/* Hang up on client sending message with payload longer than
+ * MSG_PAYLOAD_MAX. Data received is dropped. */
+static bool msg_connection_oversized(msg_connection_t *c)
 {
-    free(message);
+    message_header_t *header = (message_header_t *) (c->rx_buffer + c->rx_start);
+
+    if (((c->rx_length - c->rx_start) < sizeof(message_header_t)) ||
+        (header->payload_length <= MSG_PAYLOAD_MAX))
+    {
+        return false;
+    }
+
+    warning_printf("Message payload of %u bytes exceeds limit\n", header->payload_length);
+
+    c->rx_start = 0;
+    c->rx_length = 0;
+    c->hangup = true;
+    msg_connection_poll(c, false);
+
+    return true;
 }
 
-int msg_send(void *message)
+/* Keep file descriptors passed by client until taken by their requests */
+static void msg_connection_fds_add(msg_connection_t *c, struct msghdr *msg)
 {
-    ssize_t bytes_sent;
-    ssize_t bytes_remaining;
-    char *message_p = message;
+    struct cmsghdr *cmsg;
+    size_t count;
+    int fd;
 
-    message_header_t *header = message;
-    bytes_remaining = sizeof(message_header_t) + header->payload_length;
+    if (msg->msg_flags & MSG_CTRUNC)
+    {
+        warning_printf("File descriptors passed by client dropped\n");
+    }
 
-    while (bytes_remaining)
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg))
     {
-        bytes_sent = write(*sockfd, message_p, bytes_remaining);
-        if (bytes_sent < 0)
+        if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS))
         {
-            warning_printf("Writing to socket (%s)\n", strerror(errno));
-            return -errno;
+            continue;
         }
 
-        bytes_remaining -= bytes_sent;
-        message_p += bytes_sent;
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++)
+        {
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+            if (c->rx_fd_count == MSG_FDS_MAX)
+            {
+                warning_printf("Too many file descriptors passed by client\n");
+                close(fd);
+                continue;
+            }
+            c->rx_fds[c->rx_fd_count++] = fd;
+        }
+    }
+}
+
+/* Take oldest file descriptor passed by client, -1 if none */
+static int msg_connection_fd_take(msg_connection_t *c)
+{
+    int fd;
+
+    if (c->rx_fd_count == 0)
+    {
+        warning_printf("No file descriptor passed with request\n");
+        return -1;
     }
 
-    return 0;
+    fd = c->rx_fds[0];
+    c->rx_fd_count--;
+    memmove(&c->rx_fds[0], &c->rx_fds[1], c->rx_fd_count * sizeof(int));
+
+    return fd;
 }
 
-int msg_receive(void **message)
+static void msg_connection_fill(msg_connection_t *c)
 {
-    message_header_t header;
+    char control[CMSG_SPACE(MSG_FDS_MAX * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    message_header_t *header;
+    uint32_t required;
     ssize_t bytes_read;
-    ssize_t bytes_remaining;
-    char *message_p;
 
-    /* Read message header */
-    bytes_read = read(*sockfd, &header, sizeof(header));
-    if (bytes_read < 0)
+    /* Move partial message to start of buffer */
+    if (c->rx_start > 0)
     {
-        error_printf("Reading from (%s)\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        memmove(c->rx_buffer, c->rx_buffer + c->rx_start, c->rx_length - c->rx_start);
+        c->rx_length -= c->rx_start;
+        c->rx_start = 0;
     }
 
-    /* Allocate message (header + payload) receive buffer */
-    *message = malloc(sizeof(message_header_t) + header.payload_length);
-    if (*message == NULL)
+    if (msg_connection_oversized(c))
     {
-        error_printf("malloc() failed (%s)\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        return;
     }
 
-    /* Install header */
-    memcpy(*message, &header, sizeof(message_header_t));
+    /* Make room for at least the rest of the message being received */
+    required = c->rx_length + 1;
+    if (c->rx_length >= sizeof(message_header_t))
+    {
+        header = (message_header_t *) c->rx_buffer;
+        if (required < sizeof(message_header_t) + header->payload_length)
+        {
+            required = sizeof(message_header_t) + header->payload_length;
+        }
+    }
+    if (msg_buffer_reserve(&c->rx_buffer, &c->rx_size, required) == NULL)
+    {
+        c->hangup = true;
+        return;
+    }
 
-    /* Read message payload */
-    bytes_remaining = header.payload_length;
-    message_p = *message;
-    message_p += sizeof(message_header_t);
+    /* Read whatever is available without blocking. File descriptors are
+     * passed along with the first byte of their request. */
+    iov.iov_base = c->rx_buffer + c->rx_length;
+    iov.iov_len = c->rx_size - c->rx_length;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
 
-    while (bytes_remaining)
+    bytes_read = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (bytes_read < 0)
     {
-        bytes_read = read(*sockfd, message_p, bytes_remaining);
-        if (bytes_read < 0)
+        if ((errno != EAGAIN) && (errno != EINTR))
         {
             warning_printf("Reading from socket (%s)\n", strerror(errno));
-            return -errno;
+            c->hangup = true;
+            msg_connection_poll(c, false);
         }
+        return;
+    }
 
-        bytes_remaining -= bytes_read;
-        message_p += bytes_read;
+    if (bytes_read == 0)
+    {
+        /* Client hung up - messages already received are still handled */
+        c->hangup = true;
+        msg_connection_poll(c, false);
+        return;
     }
 
-    return 0;
-}
+    msg_connection_fds_add(c, &msg);
 
-void msg_send_rsp_ok(void)
-{
-    void *message = NULL;
+    c->rx_length += bytes_read;
 
-    // Send response
-    msg_create(&message, RSP_OK, NULL, 0);
-    msg_send(message);
-    msg_destroy(message);
+    msg_connection_oversized(c);
 }
 
-void msg_receive_rsp_ok(void)
+void message_server_listen(void (*callback)(void *message))
 {
-    void *message = NULL;
+    struct epoll_event events[MSG_EPOLL_EVENTS_MAX];
+    struct epoll_event event;
     message_header_t *header;
+    bool pending = false;
+    int count;
+    int fd;
 
-    // Receive response
-    msg_receive(&message);
-    header = message;
-    if (header->type == RSP_ERROR)
+    msg_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (msg_epoll_fd < 0)
     {
-        // char *rsp_text = message + sizeof(message_header_t);
-        // error_printf("%s", rsp_text);
+        error_printf("epoll_create1() failed (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
-    else if (header->type != RSP_OK)
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(msg_epoll_fd, EPOLL_CTL_ADD, srv_sockfd, &event) < 0)
     {
-        warning_printf("Invalid message type received\n");
+        error_printf("epoll_ctl() failed (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (watch_fd >= 0)
+    {
+        event.events = EPOLLIN;
+        event.data.ptr = &watch_fd;
+        if (epoll_ctl(msg_epoll_fd, EPOLL_CTL_ADD, watch_fd, &event) < 0)
+        {
+            error_printf("epoll_ctl() failed (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (1)
+    {
+        /* Sleep until there is activity unless requests are pending */
+        count = epoll_wait(msg_epoll_fd, events, MSG_EPOLL_EVENTS_MAX, pending ? 0 : -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            error_printf("epoll_wait() failed (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            msg_connection_t *c = events[i].data.ptr;
+
+            if (c == NULL)
+            {
+                /* Accept all new connections */
+                while ((fd = accept4(srv_sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                {
+                    msg_connection_add(fd);
+                }
+                continue;
+            }
+
+            if (events[i].data.ptr == &watch_fd)
+            {
+                watch_callback();
+                continue;
+            }
+
+            /* Only read more when there is no complete message pending */
+            if (!msg_connection_message_ready(c))
+            {
+                msg_connection_fill(c);
+            }
+        }
+
+        /* Round robin: handle at most one request per client per pass */
+        pending = false;
+        connections_resumed = false;
+        for (int i = 0; i < connection_count; i++)
+        {
+            msg_connection_t *c = connections[i];
+
+            if (c->stalled || !msg_connection_message_ready(c))
+            {
+                continue;
+            }
+
+            header = (message_header_t *) (c->rx_buffer + c->rx_start);
+            c->rx_flags = header->flags;
+            c->rx_seq = header->seq;
+
+            /* Only consecutive requests continue a job */
+            if (!(header->flags & MSG_FLAG_JOB_CONTINUE))
+            {
+                c->job_id_continued = MSG_JOB_ID_ALL;
+            }
+
+            /* A stalled request keeps the file descriptor passed with it */
+            if ((header->flags & MSG_FLAG_FD) && (c->rx_fd < 0))
+            {
+                c->rx_fd = msg_connection_fd_take(c);
+            }
+
+            /* Do callback which will handle request by writing responses */
+            connection = c;
+            callback(header);
+            connection = NULL;
+
+            if (c->stalled)
+            {
+                /* Leave request in place and stop reading until resumed */
+                msg_connection_poll(c, false);
+                continue;
+            }
+
+            /* Close file descriptor not taken by a job */
+            if (c->rx_fd >= 0)
+            {
+                close(c->rx_fd);
+                c->rx_fd = -1;
+            }
+
+            c->rx_start += sizeof(message_header_t) + header->payload_length;
+
+            if (msg_connection_message_ready(c))
+            {
+                pending = true;
+            }
+        }
+
+        /* Requests resumed by jobs completing during the pass are retried
+         * right away - their connection may have had its turn already */
+        if (connections_resumed)
+        {
+            pending = true;
+        }
+
+        /* Close connections of clients that hung up once drained */
+        for (int i = connection_count - 1; i >= 0; i--)
+        {
+            if (connections[i]->hangup && !msg_connection_message_ready(connections[i]) &&
+                (connections[i]->jobs_pending == 0))
+            {
+                msg_connection_remove(i);
+            }
+        }
+    }
+}
+
+/* Watch file descriptor in server loop and call callback when readable */
+void message_server_watch(int fd, void (*callback)(void))
+{
+    watch_fd = fd;
+    watch_callback = callback;
+}
+
+void message_server_close(void)
+{
+    close(srv_sockfd);
+}
+
+int message_client_open(void)
+{
+    struct sockaddr_un srv_addr;
+    socklen_t addr_length;
+    int status;
+
+    debug_printf("Starting socket client\n");
+
+    /* Create a UNIX file socket */
+    client_connection.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client_connection.fd < 0)
+    {
+        status = -errno;
+        error_printf("Opening socket (%s)\n", strerror(-status));
+        return status;
+    }
+
+    /* Initialize socket structure */
+    addr_length = msg_socket_address(&srv_addr);
+
+    /* Connect to the server */
+    if (connect(client_connection.fd, (struct sockaddr*)&srv_addr, addr_length) < 0)
+    {
+        status = -errno;
+        error_printf("Connect failure (%s)\n", strerror(-status));
+        close(client_connection.fd);
+        client_connection.fd = -1;
+        return status;
+    }
+
+    message_client_mode_enable();
+
+    return 0;
+}
+
+void message_client_close(void)
+{
+    debug_printf("Closing socket client\n");
+    close(client_connection.fd);
+    client_connection.fd = -1;
+}
+
+void message_client_pipeline_enable(void)
+{
+    /* Requests are sent without waiting for RSP_OK. Use
+     * do_message_sync_request() to wait for requests to be handled and to
+     * collect any errors. */
+    client_connection.pipeline = true;
+}
+
+void message_client_device_select(uint8_t id)
+{
+    client_connection.device_id = id;
+}
+
+void message_client_async_enable(bool enable)
+{
+    /* Device actions are queued as jobs and responded with job id instead
+     * of waiting for them to be performed */
+    client_connection.async = enable;
+}
+
+bool message_client_async(void)
+{
+    return client_connection.async;
+}
+
+void message_client_job_continue(bool enable)
+{
+    /* Asynchronous requests are performed as part of the job of the
+     * previous request and responded with its id */
+    client_connection.job_continue = enable;
+}
+
+uint32_t message_client_job_id(void)
+{
+    return client_connection.job_id;
+}
+
+int msg_create(
+        void **message,
+        message_type_t type,
+        void *payload,
+        uint32_t payload_length)
+{
+    message_header_t *header;
+
+    if (payload_length > MSG_PAYLOAD_MAX)
+    {
+        error_printf("Message payload of %u bytes exceeds limit\n", payload_length);
+        return -EMSGSIZE;
+    }
+
+    // Use transmit buffer of connection as message buffer
+    *message = msg_buffer_reserve(&connection->tx_buffer, &connection->tx_size,
+                                  sizeof(message_header_t) + payload_length);
+    if (*message == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    // Create message header
+    header = *message;
+    header->type = type;
+    header->flags = 0;
+    header->device_id = connection->device_id;
+    header->seq = 0;
+    header->payload_length = payload_length;
+
+    // Copy payload if any
+    if (payload_length > 0)
+    {
+        memcpy(connection->tx_buffer + sizeof(message_header_t), payload, payload_length);
+    }
+
+    return 0;
+}
+
+/* Write data passing file descriptor along with it */
+static ssize_t msg_write_fd(int sockfd, const void *buffer, size_t length, int fd)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+
+    iov.iov_base = (void *) buffer;
+    iov.iov_len = length;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+}
+
+/* Send message, passing file descriptor with it unless fd is -1 */
+static int msg_send_fd(void *message, int fd)
+{
+    ssize_t bytes_sent;
+    ssize_t bytes_remaining;
+    char *message_p = message;
+
+    message_header_t *header = message;
+    bytes_remaining = sizeof(message_header_t) + header->payload_length;
+
+    if (connection == &client_connection)
+    {
+        /* Tag request with sequence number */
+        header->seq = ++connection->tx_seq;
+        if (connection->async)
+        {
+            /* Job id is always responded */
+            header->flags |= MSG_FLAG_ASYNC;
+            if (connection->job_continue)
+            {
+                header->flags |= MSG_FLAG_JOB_CONTINUE;
+            }
+        }
+        else if (connection->pipeline)
+        {
+            header->flags |= MSG_FLAG_NO_ACK;
+        }
+    }
+    else
+    {
+        /* Tag response with sequence number of request */
+        header->seq = connection->rx_seq;
+    }
+
+    while (bytes_remaining)
+    {
+        if (fd >= 0)
+        {
+            bytes_sent = msg_write_fd(connection->fd, message_p, bytes_remaining, fd);
+        }
+        else
+        {
+            /* Peer going away must not raise SIGPIPE in library users */
+            bytes_sent = send(connection->fd, message_p, bytes_remaining, MSG_NOSIGNAL);
+        }
+        if (bytes_sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN)
+            {
+                /* Client sockets are non-blocking on server side - wait
+                 * a bounded time for client to make room */
+                struct pollfd pfd = { .fd = connection->fd, .events = POLLOUT };
+
+                if (poll(&pfd, 1, MSG_SEND_TIMEOUT_MS) > 0)
+                {
+                    continue;
+                }
+                errno = ETIMEDOUT;
+            }
+
+            warning_printf("Writing to socket (%s)\n", strerror(errno));
+            connection->hangup = true;
+            return -errno;
+        }
+
+        bytes_remaining -= bytes_sent;
+        message_p += bytes_sent;
+        fd = -1;
+    }
+
+    return 0;
+}
+
+int msg_send(void *message)
+{
+    return msg_send_fd(message, -1);
+}
+
+static int msg_read(void *buffer, size_t length)
+{
+    ssize_t bytes_read;
+    char *buffer_p = buffer;
+
+    while (length)
+    {
+        bytes_read = read(connection->fd, buffer_p, length);
+        if (bytes_read < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        if (bytes_read == 0)
+        {
+            /* Peer closed connection */
+            return -ECONNRESET;
+        }
+
+        length -= bytes_read;
+        buffer_p += bytes_read;
+    }
+
+    return 0;
+}
+
+int msg_receive(void **message)
+{
+    message_header_t header;
+    int status;
+
+    *message = NULL;
+
+    /* Read message header */
+    status = msg_read(&header, sizeof(header));
+    if (status < 0)
+    {
+        if (status != -ECONNRESET)
+        {
+            warning_printf("Reading from socket (%s)\n", strerror(-status));
+        }
+        return status;
+    }
+
+    if (header.payload_length > MSG_PAYLOAD_MAX)
+    {
+        warning_printf("Message payload of %u bytes exceeds limit\n", header.payload_length);
+        return -EPROTO;
+    }
+
+    /* Use receive buffer of connection as message (header + payload) buffer */
+    if (msg_buffer_reserve(&connection->rx_buffer, &connection->rx_size,
+                           sizeof(message_header_t) + header.payload_length) == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    /* Install header */
+    memcpy(connection->rx_buffer, &header, sizeof(message_header_t));
+
+    connection->rx_flags = header.flags;
+    connection->rx_seq = header.seq;
+
+    /* Read message payload */
+    status = msg_read(connection->rx_buffer + sizeof(message_header_t), header.payload_length);
+    if (status < 0)
+    {
+        warning_printf("Reading from socket (%s)\n", strerror(-status));
+        return status;
+    }
+
+    *message = connection->rx_buffer;
+
+    return 0;
+}
+
+void msg_send_rsp_ok(void)
+{
+    void *message = NULL;
+
+    if (connection->rx_flags & MSG_FLAG_NO_ACK)
+    {
+        return;
+    }
+
+    // Send response
+    msg_create(&message, RSP_OK, NULL, 0);
+    msg_send(message);
+}
+
+void msg_send_rsp_error(void)
+{
+    void *message = NULL;
+
+    if (connection->rx_flags & MSG_FLAG_NO_ACK)
+    {
+        /* Report error with next sync response instead. Jobs of different
+         * devices may complete out of order. */
+        if ((connection->error_count++ == 0) || (connection->rx_seq < connection->error_seq))
+        {
+            connection->error_seq = connection->rx_seq;
+        }
+        return;
+    }
+
+    // Send response
+    msg_create(&message, RSP_ERROR, NULL, 0);
+    msg_send(message);
+}
+
+int msg_receive_rsp_ok(void)
+{
+    void *message = NULL;
+    message_header_t *header;
+    int status = 0;
+
+    if (connection->pipeline && !connection->async)
+    {
+        /* No response for pipelined requests */
+        return 0;
+    }
+
+    // Receive response
+    status = msg_receive(&message);
+    if (status < 0)
+    {
+        error_printf("No response from service\n");
+        return status;
+    }
+    header = message;
+    connection->job_id = 0;
+    if ((header->type == RSP_JOB) && (header->payload_length == sizeof(message_job_data_t)))
+    {
+        /* Request is performed asynchronously */
+        message_job_data_t *job = message + sizeof(message_header_t);
+        connection->job_id = job->id;
+    }
+    else if (header->type == RSP_ERROR)
+    {
+        error_printf("Request failed\n");
+        status = -EIO;
+    }
+    else if (header->type != RSP_OK)
+    {
+        warning_printf("Invalid message type received\n");
+        status = -EPROTO;
+    }
+
+    return status;
+}
+
+/* Send request without waiting for response. Responses must be received
+ * with msg_receive_rsp_ok() in order. */
+int msg_request_send(message_type_t type, void *payload, uint32_t payload_length)
+{
+    void *message = NULL;
+    int status;
+
+    status = msg_create(&message, type, payload, payload_length);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    return msg_send(message);
+}
+
+int msg_request(message_type_t type, void *payload, uint32_t payload_length)
+{
+    int status;
+
+    status = msg_request_send(type, payload, payload_length);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    return msg_receive_rsp_ok();
+}
+
+/* Send request passing file descriptor to service, which takes a duplicate
+ * of it, and wait for response */
+int msg_request_fd(message_type_t type, void *payload, uint32_t payload_length, int fd)
+{
+    message_header_t *header;
+    void *message = NULL;
+    int status;
+
+    status = msg_create(&message, type, payload, payload_length);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    header = message;
+    header->flags |= MSG_FLAG_FD;
+
+    status = msg_send_fd(message, fd);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    return msg_receive_rsp_ok();
+}
+
+/* Stall request of connection until its jobs are completed. Returns true
+ * if request must wait. */
+bool msg_barrier(void)
+{
+    if (connection->jobs_pending > 0)
+    {
+        connection->stalled = true;
+        return true;
+    }
+
+    return false;
+}
+
+/* Stall request of connection until a job completes */
+void msg_stall(void)
+{
+    connection->stalled = true;
+}
+
+static void msg_send_rsp_job(uint32_t id, job_state_t state)
+{
+    message_job_data_t job = { .id = id, .state = state };
+    void *message = NULL;
+
+    msg_create(&message, RSP_JOB, &job, sizeof(job));
+    msg_send(message);
+}
+
+static msg_job_t *msg_job_find(uint32_t id)
+{
+    for (msg_job_t *job = jobs_active; job != NULL; job = job->next)
+    {
+        if (job->id == id)
+        {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+static job_state_t msg_job_state(uint32_t id)
+{
+    msg_job_t *job = msg_job_find(id);
+
+    if (job != NULL)
+    {
+        return job->state;
+    }
+
+    if ((id != MSG_JOB_ID_ALL) && (job_results[id % MSG_JOB_RESULTS_MAX].id == id))
+    {
+        return job_results[id % MSG_JOB_RESULTS_MAX].state;
+    }
+
+    return JOB_UNKNOWN;
+}
+
+/* Take job from free list, growing its message storage if needed. The free
+ * list holds at most as many jobs as were active at once, which devices bound
+ * to DEVICE_JOBS_MAX each. */
+static msg_job_t *msg_job_alloc(uint32_t length)
+{
+    msg_job_t *job = jobs_free;
+    msg_job_t *new_job;
+    uint32_t size;
+
+    if (job != NULL)
+    {
+        jobs_free = job->next;
+        if (job->message_size >= length)
+        {
+            return job;
+        }
+    }
+
+    size = MSG_BUFFER_SIZE_MIN;
+    while (size < length)
+    {
+        size *= 2;
+    }
+
+    new_job = realloc(job, sizeof(msg_job_t) + size);
+    if (new_job == NULL)
+    {
+        error_printf("realloc() failed (%s)\n", strerror(errno));
+        if (job != NULL)
+        {
+            job->next = jobs_free;
+            jobs_free = job;
+        }
+        return NULL;
+    }
+
+    new_job->message_size = size;
+
+    return new_job;
+}
+
+/* Return job to free list */
+static void msg_job_free(msg_job_t *job)
+{
+    if (job->message_size > MSG_JOB_SIZE_KEEP_MAX)
+    {
+        free(job);
+        return;
+    }
+
+    job->next = jobs_free;
+    jobs_free = job;
+}
+
+msg_job_t *msg_job_create(void *message, void *owner, void (*cancel_callback)(msg_job_t *job))
+{
+    message_header_t *header = message;
+    uint32_t length = sizeof(message_header_t) + header->payload_length;
+    uint32_t id = connection->job_id_continued;
+    job_state_t state;
+    msg_job_t *job;
+
+    /* Request continuing job of previous request shares its id, unless
+     * that job failed or was cancelled meanwhile */
+    if (connection->rx_flags & MSG_FLAG_JOB_CONTINUE)
+    {
+        state = msg_job_state(id);
+        if ((state == JOB_FAILED) || (state == JOB_CANCELLED) || (state == JOB_UNKNOWN))
+        {
+            warning_printf("Job %u can not be continued\n", id);
+            return NULL;
+        }
+    }
+
+    job = msg_job_alloc(length);
+    if (job == NULL)
+    {
+        return NULL;
+    }
+
+    if (!(connection->rx_flags & MSG_FLAG_JOB_CONTINUE))
+    {
+        /* Job ids wrap around skipping MSG_JOB_ID_ALL */
+        if (++job_id_last == MSG_JOB_ID_ALL)
+        {
+            job_id_last++;
+        }
+        id = job_id_last;
+    }
+
+    job->id = id;
+    job->connection = connection;
+    job->flags = connection->rx_flags;
+    job->seq = connection->rx_seq;
+    job->state = JOB_QUEUED;
+    job->cancel = false;
+    job->cancel_callback = cancel_callback;
+    job->owner = owner;
+    job->step = 0;
+    job->fd = connection->rx_fd;
+    job->queue_next = NULL;
+    memcpy(job->message, message, length);
+
+    /* Job owns file descriptor passed with request */
+    connection->rx_fd = -1;
+
+    job->prev = NULL;
+    job->next = jobs_active;
+    if (jobs_active != NULL)
+    {
+        jobs_active->prev = job;
+    }
+    jobs_active = job;
+
+    if (job->flags & MSG_FLAG_ASYNC)
+    {
+        /* Respond with job id now - client does not wait for job */
+        connection->job_id_continued = job->id;
+        job->connection = NULL;
+        msg_send_rsp_job(job->id, JOB_QUEUED);
+    }
+    else
+    {
+        connection->jobs_pending++;
+    }
+
+    return job;
+}
+
+/* Cancel job. Owner of job is told so that a queued job is not performed
+ * and a running job is stopped. */
+void msg_job_cancel(msg_job_t *job)
+{
+    if (job->cancel)
+    {
+        return;
+    }
+
+    job->cancel = true;
+
+    if (job->cancel_callback != NULL)
+    {
+        job->cancel_callback(job);
+    }
+}
+
+/* Send response of finished job and release it */
+void msg_job_complete(msg_job_t *job, job_state_t state)
+{
+    msg_connection_t *connection_saved = connection;
+    msg_connection_t *c = job->connection;
+
+    /* Keep final state for status requests. A job continued by further
+     * requests keeps the state of the first of them not done. */
+    if ((job_results[job->id % MSG_JOB_RESULTS_MAX].id != job->id) ||
+        (job_results[job->id % MSG_JOB_RESULTS_MAX].state == JOB_DONE))
+    {
+        job_results[job->id % MSG_JOB_RESULTS_MAX].id = job->id;
+        job_results[job->id % MSG_JOB_RESULTS_MAX].state = state;
+    }
+
+    if (job->prev != NULL)
+    {
+        job->prev->next = job->next;
+    }
+    else
+    {
+        jobs_active = job->next;
+    }
+    if (job->next != NULL)
+    {
+        job->next->prev = job->prev;
+    }
+
+    if (c != NULL)
+    {
+        uint8_t rx_flags = c->rx_flags;
+        uint32_t rx_seq = c->rx_seq;
+
+        connection = c;
+        c->rx_flags = job->flags;
+        c->rx_seq = job->seq;
+
+        if (!c->hangup)
+        {
+            if (state != JOB_DONE)
+            {
+                msg_send_rsp_error();
+            }
+            else
+            {
+                msg_send_rsp_ok();
+            }
+        }
+
+        c->rx_flags = rx_flags;
+        c->rx_seq = rx_seq;
+        connection = connection_saved;
+
+        c->jobs_pending--;
+    }
+
+    if (job->fd >= 0)
+    {
+        close(job->fd);
+    }
+    msg_job_free(job);
+
+    /* Retry stalled requests */
+    for (int i = 0; i < connection_count; i++)
+    {
+        if (connections[i]->stalled)
+        {
+            connections[i]->stalled = false;
+            connections_resumed = true;
+            if (!connections[i]->hangup)
+            {
+                msg_connection_poll(connections[i], true);
+            }
+        }
+    }
+}
+
+/* File descriptor passed with request performed by job, -1 if none. The
+ * file descriptor is closed when the job completes. */
+int msg_job_fd(void *message)
+{
+    msg_job_t *job = (msg_job_t *) ((char *) message - offsetof(msg_job_t, message));
+
+    return job->fd;
+}
+
+const char *msg_job_state_name(job_state_t state)
+{
+    switch (state)
+    {
+        case JOB_QUEUED:
+            return "queued";
+        case JOB_RUNNING:
+            return "running";
+        case JOB_DONE:
+            return "done";
+        case JOB_FAILED:
+            return "failed";
+        case JOB_CANCELLED:
+            return "cancelled";
+        default:
+            return "unknown";
+    }
+}
+
+static uint32_t *msg_job_request_id(void *message)
+{
+    message_header_t *header = message;
+
+    if (header->payload_length != sizeof(uint32_t))
+    {
+        warning_printf("Invalid payload length\n");
+        msg_send_rsp_error();
+        return NULL;
+    }
+
+    return message + sizeof(message_header_t);
+}
+
+void do_message_job_status(void *message)
+{
+    uint32_t *id = msg_job_request_id(message);
+
+    if (id != NULL)
+    {
+        msg_send_rsp_job(*id, msg_job_state(*id));
+    }
+}
+
+void do_message_job_wait(void *message)
+{
+    uint32_t *id = msg_job_request_id(message);
+
+    if (id == NULL)
+    {
+        return;
+    }
+
+    /* Check again when a job completes */
+    if (msg_job_find(*id) != NULL)
+    {
+        msg_stall();
+        return;
+    }
+
+    msg_send_rsp_job(*id, msg_job_state(*id));
+}
+
+void do_message_job_cancel(void *message)
+{
+    uint32_t *id = msg_job_request_id(message);
+    msg_job_t *job, *next;
+
+    if (id == NULL)
+    {
+        return;
+    }
+
+    if (*id == MSG_JOB_ID_ALL)
+    {
+        /* Cancelling a queued job completes it right away */
+        for (job = jobs_active; job != NULL; job = next)
+        {
+            next = job->next;
+            msg_job_cancel(job);
+        }
+        msg_send_rsp_ok();
+        return;
+    }
+
+    /* Job continued by several requests is active in as many parts */
+    if (msg_job_find(*id) != NULL)
+    {
+        for (job = jobs_active; job != NULL; job = next)
+        {
+            next = job->next;
+            if (job->id == *id)
+            {
+                msg_job_cancel(job);
+            }
+        }
+    }
+    else if (msg_job_state(*id) == JOB_UNKNOWN)
+    {
+        warning_printf("No job with id %u\n", *id);
+        msg_send_rsp_error();
+        return;
+    }
+
+    msg_send_rsp_ok();
+}
+
+static int msg_job_request(message_type_t type, uint32_t id, job_state_t *state)
+{
+    void *message = NULL;
+    message_header_t *header;
+    message_job_data_t *job;
+    int status;
+
+    status = msg_create(&message, type, &id, sizeof(id));
+    if (status < 0)
+    {
+        return status;
+    }
+
+    status = msg_send(message);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    status = msg_receive(&message);
+    if (status < 0)
+    {
+        error_printf("No response from service\n");
+        return status;
+    }
+    header = message;
+    if ((header->type != RSP_JOB) || (header->payload_length != sizeof(message_job_data_t)))
+    {
+        warning_printf("Invalid message type received\n");
+        return -EPROTO;
+    }
+
+    job = message + sizeof(message_header_t);
+    *state = job->state;
+
+    return 0;
+}
+
+int do_message_job_status_request(uint32_t id, job_state_t *state)
+{
+    return msg_job_request(REQ_JOB_STATUS, id, state);
+}
+
+int do_message_job_wait_request(uint32_t id, job_state_t *state)
+{
+    return msg_job_request(REQ_JOB_WAIT, id, state);
+}
+
+int do_message_job_cancel_request(uint32_t id)
+{
+    bool async = connection->async;
+    int status;
+
+    /* Cancel is acknowledged even in asynchronous mode */
+    connection->async = false;
+    status = msg_request(REQ_JOB_CANCEL, &id, sizeof(id));
+    connection->async = async;
+
+    return status;
+}
+
+void do_message_sync(void *message)
+{
+    message_sync_data_t sync;
+
+    UNUSED(message);
+
+    /* Wait for requests queued as jobs of devices */
+    if (msg_barrier())
+    {
+        return;
+    }
+
+    /* Everything up to and including this request has been handled */
+    sync.seq = connection->rx_seq;
+    sync.errors = connection->error_count;
+    sync.error_seq = connection->error_seq;
+
+    connection->error_count = 0;
+    connection->error_seq = 0;
+
+    msg_create(&message, RSP_SYNC, &sync, sizeof(sync));
+    msg_send(message);
+}
+
+int do_message_sync_request(message_sync_data_t *sync)
+{
+    void *message = NULL;
+    message_header_t *header;
+    int status = 0;
+
+    status = msg_create(&message, REQ_SYNC, NULL, 0);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    status = msg_send(message);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    // Receive cumulative response
+    status = msg_receive(&message);
+    if (status < 0)
+    {
+        error_printf("No response from service\n");
+        return status;
+    }
+    header = message;
+    if ((header->type != RSP_SYNC) || (header->payload_length != sizeof(message_sync_data_t)))
+    {
+        warning_printf("Invalid message type received\n");
+        return -EPROTO;
+    }
+
+    memcpy(sync, (char *) message + sizeof(message_header_t), sizeof(message_sync_data_t));
+
+    if (sync->errors > 0)
+    {
+        error_printf("%u request(s) failed, first failure at request %u\n", sync->errors, sync->error_seq);
+        status = -EIO;
     }
 
-    msg_destroy(message);
+    return status;
 }
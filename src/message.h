@@ -22,12 +22,54 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Environment variable selecting service instance */
+#define MSG_INSTANCE_ENV "INPUT_EMULATOR_INSTANCE"
+
+/* Message header flags */
+#define MSG_FLAG_NO_ACK (1 << 0) // Do not send RSP_OK/RSP_ERROR for request
+#define MSG_FLAG_ASYNC  (1 << 1) // Respond with RSP_JOB once request is queued
+#define MSG_FLAG_FD     (1 << 2) // File descriptor passed with request (SCM_RIGHTS)
+#define MSG_FLAG_JOB_CONTINUE (1 << 3) // Asynchronous request continues job of previous request
+
+/* Maximum payload length of a message */
+#define MSG_PAYLOAD_MAX (16 * 1024 * 1024)
+
+/* Job id addressing all jobs */
+#define MSG_JOB_ID_ALL 0
+
 typedef struct __attribute__((__packed__))
 {
     uint8_t type;
+    uint8_t flags;
+    uint8_t device_id; // Target device of request (see device.h)
+    uint32_t seq;
     uint32_t payload_length;
 } message_header_t;
 
+typedef struct
+{
+    uint32_t seq;       // Sequence number of last request handled
+    uint32_t errors;    // Number of failed requests since last sync
+    uint32_t error_seq; // Sequence number of first failed request
+} message_sync_data_t;
+
+/* State of job performing a device action request */
+typedef enum
+{
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED,
+    JOB_UNKNOWN,
+} job_state_t;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t state;
+} message_job_data_t;
+
 typedef enum
 {
     REQ_KBD_START,
@@ -49,18 +91,80 @@ typedef enum
     RSP_STOP,
     RSP_OK,
     RSP_ERROR,
+    REQ_SYNC,
+    RSP_SYNC,
+    REQ_BATCH,
+    REQ_JOB_STATUS,
+    REQ_JOB_WAIT,
+    REQ_JOB_CANCEL,
+    RSP_JOB,
+    REQ_KBD_LAYOUT,
+    REQ_KBD_TYPE_FILE,
 } message_type_t;
 
-void message_server_open(void);
+/* Request performed as a job in steps by the server loop. The request is
+ * copied as the receive buffer of the connection is reused. Completed jobs
+ * are kept on a free list and reused together with their message storage. */
+typedef struct msg_job msg_job_t;
+
+struct msg_job
+{
+    uint32_t id;
+    struct msg_connection *connection; // NULL for asynchronous jobs
+    uint8_t flags;
+    uint32_t seq;
+    job_state_t state;
+    bool cancel;
+    void (*cancel_callback)(msg_job_t *job);
+    void *owner;                       // Performer of job (e.g. device)
+    void (*action)(void);              // Action of owner (cast to its type)
+    uint32_t step;                     // Next step of job
+    int fd;                            // File descriptor passed with request or -1
+    msg_job_t *queue_next;             // Job queue of owner
+    msg_job_t *next;                   // Active jobs
+    msg_job_t *prev;
+    uint32_t message_size;             // Storage allocated for message
+    char message[];
+};
+
+int message_instance_select(const char *name);
+const char *message_instance(void);
+int message_server_activated(void);
+void message_server_open(int backlog);
 void message_server_close(void);
-void message_client_open(void);
+int message_client_open(void);
 void message_client_mode_enable(void);
 void message_client_close(void);
-void message_server_listen(void (*callback)(void));
+void message_client_pipeline_enable(void);
+void message_client_device_select(uint8_t id);
+void message_client_async_enable(bool enable);
+bool message_client_async(void);
+void message_client_job_continue(bool enable);
+uint32_t message_client_job_id(void);
+void message_server_listen(void (*callback)(void *message));
+void message_server_watch(int fd, void (*callback)(void));
 int msg_create(void **message, message_type_t type, void *payload, uint32_t payload_length);
-void msg_destroy(void *message);
 int msg_send(void *message);
 int msg_receive(void **message);
 void msg_send_rsp_ok(void);
-void msg_receive_rsp_ok(void);
+void msg_send_rsp_error(void);
+int msg_receive_rsp_ok(void);
+int msg_request_send(message_type_t type, void *payload, uint32_t payload_length);
+int msg_request(message_type_t type, void *payload, uint32_t payload_length);
+int msg_request_fd(message_type_t type, void *payload, uint32_t payload_length, int fd);
+bool msg_barrier(void);
+void msg_stall(void);
+msg_job_t *msg_job_create(void *message, void *owner, void (*cancel_callback)(msg_job_t *job));
+void msg_job_cancel(msg_job_t *job);
+void msg_job_complete(msg_job_t *job, job_state_t state);
+int msg_job_fd(void *message);
+const char *msg_job_state_name(job_state_t state);
+void do_message_job_status(void *message);
+int do_message_job_status_request(uint32_t id, job_state_t *state);
+void do_message_job_wait(void *message);
+int do_message_job_wait_request(uint32_t id, job_state_t *state);
+void do_message_job_cancel(void *message);
+int do_message_job_cancel_request(uint32_t id);
+void do_message_sync(void *message);
+int do_message_sync_request(message_sync_data_t *sync);
 bool message_server_running(void);
@@ -53,3 +53,104 @@ wchar_t *convert_mbs_to_wcs(const char *string)
 
     return wcs;
 }
+
+/* Encode character as UTF-8 in buffer of at least UTF8_LENGTH_MAX bytes.
+ * Invalid characters are encoded as U+FFFD. Returns number of bytes. */
+size_t utf8_encode(uint32_t wc, char *buffer)
+{
+    unsigned char *b = (unsigned char *) buffer;
+
+    if ((wc > 0x10ffff) || ((wc >= 0xd800) && (wc <= 0xdfff)))
+    {
+        wc = 0xfffd;
+    }
+
+    if (wc < 0x80)
+    {
+        b[0] = wc;
+        return 1;
+    }
+    if (wc < 0x800)
+    {
+        b[0] = 0xc0 | (wc >> 6);
+        b[1] = 0x80 | (wc & 0x3f);
+        return 2;
+    }
+    if (wc < 0x10000)
+    {
+        b[0] = 0xe0 | (wc >> 12);
+        b[1] = 0x80 | ((wc >> 6) & 0x3f);
+        b[2] = 0x80 | (wc & 0x3f);
+        return 3;
+    }
+
+    b[0] = 0xf0 | (wc >> 18);
+    b[1] = 0x80 | ((wc >> 12) & 0x3f);
+    b[2] = 0x80 | ((wc >> 6) & 0x3f);
+    b[3] = 0x80 | (wc & 0x3f);
+    return 4;
+}
+
+/* Decode first character of UTF-8 string of given length. Returns number of
+ * bytes of character or -1 if invalid or truncated. */
+int utf8_decode(const char *string, size_t length, uint32_t *wc)
+{
+    const unsigned char *s = (const unsigned char *) string;
+    uint32_t min;
+    size_t count;
+
+    if (length == 0)
+    {
+        return -1;
+    }
+
+    if (s[0] < 0x80)
+    {
+        *wc = s[0];
+        return 1;
+    }
+    else if ((s[0] & 0xe0) == 0xc0)
+    {
+        *wc = s[0] & 0x1f;
+        count = 2;
+        min = 0x80;
+    }
+    else if ((s[0] & 0xf0) == 0xe0)
+    {
+        *wc = s[0] & 0x0f;
+        count = 3;
+        min = 0x800;
+    }
+    else if ((s[0] & 0xf8) == 0xf0)
+    {
+        *wc = s[0] & 0x07;
+        count = 4;
+        min = 0x10000;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (count > length)
+    {
+        return -1;
+    }
+
+    for (size_t i = 1; i < count; i++)
+    {
+        if ((s[i] & 0xc0) != 0x80)
+        {
+            return -1;
+        }
+        *wc = (*wc << 6) | (s[i] & 0x3f);
+    }
+
+    /* Reject overlong encodings, surrogates and out of range characters */
+    if ((*wc < min) || (*wc > 0x10ffff) || ((*wc >= 0xd800) && (*wc <= 0xdfff)))
+    {
+        return -1;
+    }
+
+    return count;
+}
@@ -19,12 +19,16 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <wchar.h>
 
 #define UNUSED(expr) do { (void)(expr); } while (0)
 
 #define SYS_NAME_LENGTH_MAX 50
 
+#define UTF8_LENGTH_MAX 4 // Longest UTF-8 encoding of a character
+
 #define do_ioctl(fd, request, args...) \
 { \
     int status = ioctl(fd, request, ## args); \
@@ -36,3 +40,5 @@
 }
 
 wchar_t *convert_mbs_to_wcs(const char *string);
+size_t utf8_encode(uint32_t wc, char *buffer);
+int utf8_decode(const char *string, size_t length, uint32_t *wc);
@@ -28,151 +28,124 @@
 #include "options.h"
 #include "message.h"
 #include "event.h"
+#include "uinput.h"
+#include "device.h"
 #include "mouse.h"
 #include "service.h"
 #include "print.h"
 #include "misc.h"
 
-static int mouse_fd = -1;
-static char sys_name[SYS_NAME_LENGTH_MAX];
-static int mouse_config_x_max;
-static int mouse_config_y_max;
-
-int mouse_x_max(void)
-{
-    return mouse_config_x_max;
-}
-
-int mouse_y_max(void)
-{
-    return mouse_config_y_max;
-}
-
-void mouse_move(int x_rel, int y_rel)
+void mouse_move(input_device_t *mouse, int x_rel, int y_rel)
 {
-    /* Do nothing if no device */
-    if (mouse_fd < 0)
-    {
-        return;
-    }
+    event_frame_t frame;
 
     debug_printf("Mouse move %d,%d\n", x_rel, y_rel);
 
     // Move mouse absolute
-    // emit(mouse_fd, EV_ABS, ABS_X, x);
-    // emit(mouse_fd, EV_ABS, ABS_Y, y);
-    // emit(mouse_fd, EV_SYN, SYN_REPORT, 0);
+    // event_frame_add(&frame, EV_ABS, ABS_X, x);
+    // event_frame_add(&frame, EV_ABS, ABS_Y, y);
 
     // Move mouse relative
-    emit(mouse_fd, EV_REL, REL_X, x_rel);
-    emit(mouse_fd, EV_REL, REL_Y, y_rel);
-    emit(mouse_fd, EV_SYN, SYN_REPORT, 0);
+    event_frame_begin(&frame, mouse->fd, &mouse->commit_ns);
+    event_frame_add(&frame, EV_REL, REL_X, x_rel);
+    event_frame_add(&frame, EV_REL, REL_Y, y_rel);
+    event_frame_commit(&frame);
 }
 
-void mouse_press(int button)
+void mouse_press(input_device_t *mouse, int button)
 {
-    /* Do nothing if no device */
-    if (mouse_fd < 0)
-    {
-        return;
-    }
+    event_frame_t frame;
 
     // Press button
-    emit(mouse_fd, EV_KEY, button, 1);
-    emit(mouse_fd, EV_SYN, SYN_REPORT, 0);
-}
+    event_frame_begin(&frame, mouse->fd, &mouse->commit_ns);
+    event_frame_add(&frame, EV_KEY, button, 1);
+    event_frame_commit(&frame);
 
-void mouse_release(int button)
-{
-    /* Do nothing if no device */
-    if (mouse_fd < 0)
-    {
-        return;
-    }
-
-    // Press button
-    emit(mouse_fd, EV_KEY, button, 0);
-    emit(mouse_fd, EV_SYN, SYN_REPORT, 0);
+    device_key_held(mouse, button, true);
 }
 
-void mouse_click(int button)
+void mouse_release(input_device_t *mouse, int button)
 {
-    /* Do nothing if no device */
-    if (mouse_fd < 0)
-    {
-        return;
-    }
+    event_frame_t frame;
 
-    debug_printf("Mouse click 0x%x\n", button);
+    // Release button
+    event_frame_begin(&frame, mouse->fd, &mouse->commit_ns);
+    event_frame_add(&frame, EV_KEY, button, 0);
+    event_frame_commit(&frame);
 
-    mouse_press(button);
-    usleep(1000);
-    mouse_release(button);
+    device_key_held(mouse, button, false);
 }
 
-void mouse_scroll(int32_t ticks)
+void mouse_scroll(input_device_t *mouse, int32_t ticks)
 {
-    /* Do nothing if no device */
-    if (mouse_fd < 0)
-    {
-        return;
-    }
+    event_frame_t frame;
 
     // Scroll wheel number of ticks
-    emit(mouse_fd, EV_REL, REL_WHEEL, ticks);
-    emit(mouse_fd, EV_SYN, SYN_REPORT, 0);
+    event_frame_begin(&frame, mouse->fd, &mouse->commit_ns);
+    event_frame_add(&frame, EV_REL, REL_WHEEL, ticks);
+    event_frame_commit(&frame);
 }
 
-int mouse_create(int x_max, int y_max)
+int mouse_create(unsigned int id, int x_max, int y_max)
 {
-    static struct uinput_setup usetup;
-    static struct uinput_abs_setup abs_setup;
+    struct uinput_setup usetup;
+    struct uinput_abs_setup abs_setup;
+    input_device_t *mouse;
+    int fd;
 
-    if (mouse_fd >= 0)
+    mouse = device_entry(DEV_MOUSE, id);
+    if (mouse == NULL)
+    {
+        error_printf("Invalid mouse id %u\n", id);
+        return -1;
+    }
+
+    if (mouse->online)
     {
         /* Mouse already started */
         return -1;
     }
 
-    mouse_config_x_max = x_max;
-    mouse_config_y_max = y_max;
+    mouse->x_max = x_max;
+    mouse->y_max = y_max;
 
-    mouse_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (mouse_fd < 0)
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0)
     {
         error_printf("Could not open /dev/uinput (%s)\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
     /* Enable button events */
-    do_ioctl(mouse_fd, UI_SET_EVBIT, EV_KEY);
-    do_ioctl(mouse_fd, UI_SET_KEYBIT, BTN_LEFT);
-    do_ioctl(mouse_fd, UI_SET_KEYBIT, BTN_MIDDLE);
-    do_ioctl(mouse_fd, UI_SET_KEYBIT, BTN_RIGHT);
-    do_ioctl(mouse_fd, UI_SET_KEYBIT, BTN_SIDE);
-    do_ioctl(mouse_fd, UI_SET_KEYBIT, BTN_EXTRA);
+    do_ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    do_ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+    do_ioctl(fd, UI_SET_KEYBIT, BTN_MIDDLE);
+    do_ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT);
+    do_ioctl(fd, UI_SET_KEYBIT, BTN_SIDE);
+    do_ioctl(fd, UI_SET_KEYBIT, BTN_EXTRA);
 
     /* Enable relative movement events */
-    do_ioctl(mouse_fd, UI_SET_EVBIT, EV_REL);
-    do_ioctl(mouse_fd, UI_SET_RELBIT, REL_X);
-    do_ioctl(mouse_fd, UI_SET_RELBIT, REL_Y);
-    do_ioctl(mouse_fd, UI_SET_RELBIT, REL_WHEEL);
+    do_ioctl(fd, UI_SET_EVBIT, EV_REL);
+    do_ioctl(fd, UI_SET_RELBIT, REL_X);
+    do_ioctl(fd, UI_SET_RELBIT, REL_Y);
+    do_ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
 
     /* Enable absolute movement events */
-    do_ioctl(mouse_fd, UI_SET_EVBIT, EV_ABS);
-    do_ioctl(mouse_fd, UI_SET_ABSBIT, ABS_X);
-    do_ioctl(mouse_fd, UI_SET_ABSBIT, ABS_Y);
+    do_ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    do_ioctl(fd, UI_SET_ABSBIT, ABS_X);
+    do_ioctl(fd, UI_SET_ABSBIT, ABS_Y);
 
     /* Set up mouse properties (resolution) */
+    memset(&abs_setup, 0, sizeof(abs_setup));
     abs_setup.code = ABS_X;
     abs_setup.absinfo.minimum = 0;
     abs_setup.absinfo.maximum = x_max;
-    do_ioctl(mouse_fd, UI_ABS_SETUP, &abs_setup);
+    do_ioctl(fd, UI_ABS_SETUP, &abs_setup);
 
     abs_setup.code = ABS_Y;
     abs_setup.absinfo.minimum = 0;
     abs_setup.absinfo.maximum = y_max;
-    do_ioctl(mouse_fd, UI_ABS_SETUP, &abs_setup);
+    do_ioctl(fd, UI_ABS_SETUP, &abs_setup);
 
     /* Set up device */
     memset(&usetup, 0, sizeof(usetup));
@@ -180,72 +153,24 @@ int mouse_create(int x_max, int y_max)
     usetup.id.vendor = 0x1111;
     usetup.id.product = 0x1111;
     usetup.id.version = 1;
-    strcpy(usetup.name, "Simulated mouse");
-    do_ioctl(mouse_fd, UI_DEV_SETUP, &usetup);
+    device_name(mouse, "Simulated mouse", usetup.name, sizeof(usetup.name));
+    do_ioctl(fd, UI_DEV_SETUP, &usetup);
 
     /* Create device */
-    do_ioctl(mouse_fd, UI_DEV_CREATE);
-
-    /*
-     * On UI_DEV_CREATE the kernel will create the device node for this
-     * device. We are inserting a pause here so that userspace has time
-     * to detect, initialize the new device, and can start listening to
-     * the event, otherwise it will not notice the event we are about
-     * to send. This pause is only needed in our example code!
-     */
-    sleep(1);
-
-    device_ref_count++;
-
-    debug_printf("Created mouse input device with x-max=%d y-max=%d\n", x_max, y_max);
-
-    /* Save sys name */
-    do_ioctl(mouse_fd, UI_GET_SYSNAME(50), sys_name);
-
-    return 0;
-}
-
-void mouse_destroy(void)
-{
-    /*
-     * Give userspace some time to read the events before we destroy the
-     * device with UI_DEV_DESTROY.
-     */
-    sleep(1);
-
-    if (mouse_fd < 0)
+    if (uinput_create(fd, mouse->sys_name) < 0)
     {
-        return;
+        close(fd);
+        return -1;
     }
 
-    debug_printf("Destroying mouse input device\n");
+    device_add(mouse, fd);
 
-    do_ioctl(mouse_fd, UI_DEV_DESTROY);
-    close(mouse_fd);
+    debug_printf("Created mouse input device %u with x-max=%d y-max=%d\n", id, x_max, y_max);
 
-    mouse_fd = -1;
-
-    sys_name[0] = 0;
-
-    device_ref_count--;
-}
-
-const char* mouse_sys_name(void)
-{
-    return sys_name;
-}
-
-bool mouse_online(void)
-{
-    if (mouse_fd >= 0)
-    {
-        return true;
-    }
-
-    return false;
+    return 0;
 }
 
-void do_mouse_click(void *message)
+int do_mouse_click(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay)
 {
     message_header_t *header = message;
     int *button = message + sizeof(message_header_t);
@@ -253,135 +178,98 @@ void do_mouse_click(void *message)
     if (header->payload_length != sizeof(int))
     {
         warning_printf("Invalid payload length");
-        return;
+        return -1;
     }
 
-    mouse_click(*button);
-
-    msg_send_rsp_ok();
-}
+    /* Press button and release it after 1 ms */
+    if (step == 0)
+    {
+        debug_printf("Mouse click 0x%x\n", *button);
 
-void do_mouse_click_request(int button)
-{
-    void *message = NULL;
+        mouse_press(mouse, *button);
+        *delay = 1;
+        return ACTION_WAIT;
+    }
 
-    msg_create(&message, REQ_MOUSE_BUTTON, &button, sizeof(button));
-    msg_send(message);
-    msg_destroy(message);
+    mouse_release(mouse, *button);
 
-    msg_receive_rsp_ok();
+    return ACTION_DONE;
 }
 
-void do_mouse_scroll(void *message)
+int do_mouse_scroll(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay)
 {
     message_header_t *header = message;
     int32_t *ticks = message + sizeof(message_header_t);
 
+    UNUSED(step);
+    UNUSED(delay);
+
     if (header->payload_length != sizeof(int32_t))
     {
         warning_printf("Invalid payload length");
-        return;
+        return -1;
     }
 
-    mouse_scroll(*ticks);
+    mouse_scroll(mouse, *ticks);
 
-    msg_send_rsp_ok();
+    return ACTION_DONE;
 }
 
-void do_mouse_scroll_request(int32_t ticks)
-{
-    void *message = NULL;
-
-    msg_create(&message, REQ_MOUSE_SCROLL, &ticks, sizeof(ticks));
-    msg_send(message);
-    msg_destroy(message);
-
-    msg_receive_rsp_ok();
-}
-
-void do_mouse_down(void *message)
+int do_mouse_down(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay)
 {
     message_header_t *header = message;
     int *button = message + sizeof(message_header_t);
 
+    UNUSED(step);
+    UNUSED(delay);
+
     if (header->payload_length != sizeof(int))
     {
         warning_printf("Invalid payload length");
-        return;
+        return -1;
     }
 
-    mouse_press(*button);
+    mouse_press(mouse, *button);
 
-    msg_send_rsp_ok();
+    return ACTION_DONE;
 }
 
-void do_mouse_down_request(int button)
-{
-    void *message = NULL;
-
-    msg_create(&message, REQ_MOUSE_BUTTONDOWN, &button, sizeof(button));
-    msg_send(message);
-    msg_destroy(message);
-
-    msg_receive_rsp_ok();
-}
-
-void do_mouse_up(void *message)
+int do_mouse_up(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay)
 {
     message_header_t *header = message;
     int *button = message + sizeof(message_header_t);
 
+    UNUSED(step);
+    UNUSED(delay);
+
     if (header->payload_length != sizeof(int))
     {
         warning_printf("Invalid payload length");
-        return;
+        return -1;
     }
 
-    mouse_release(*button);
-
-    msg_send_rsp_ok();
-}
-
-void do_mouse_up_request(int button)
-{
-    void *message = NULL;
-
-    msg_create(&message, REQ_MOUSE_BUTTONUP, &button, sizeof(button));
-    msg_send(message);
-    msg_destroy(message);
+    mouse_release(mouse, *button);
 
-    msg_receive_rsp_ok();
+    return ACTION_DONE;
 }
 
-void do_mouse_move(void *message)
+int do_mouse_move(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay)
 {
     message_header_t *header = message;
     mouse_move_data_t *move = message + sizeof(message_header_t);
 
+    UNUSED(step);
+    UNUSED(delay);
+
     if (header->payload_length != sizeof(mouse_move_data_t))
     {
         warning_printf("Invalid payload length");
-        return;
+        return -1;
     }
 
-    mouse_move(move->x, move->y);
+    mouse_move(mouse, move->x, move->y);
 
-    msg_send_rsp_ok();
-}
-
-void do_mouse_move_request(int32_t x, int32_t y)
-{
-    void *message = NULL;
-    mouse_move_data_t mouse_move_data;
-
-    mouse_move_data.x = x;
-    mouse_move_data.y = y;
-
-    msg_create(&message, REQ_MOUSE_MOVE, &mouse_move_data, sizeof(mouse_move_data_t));
-    msg_send(message);
-    msg_destroy(message);
-
-    msg_receive_rsp_ok();
+    return ACTION_DONE;
 }
 
 void do_mouse_start(void *message)
@@ -392,28 +280,17 @@ void do_mouse_start(void *message)
     if (header->payload_length != sizeof(mouse_start_data_t))
     {
         warning_printf("Warning: Invalid payload length\n");
+        msg_send_rsp_error();
         return;
     }
 
-    mouse_create(data->x_max, data->y_max);
+    if ((mouse_create(header->device_id, data->x_max, data->y_max) < 0) &&
+        (device_lookup(DEV_MOUSE, header->device_id) == NULL))
+    {
+        msg_send_rsp_error();
+        return;
+    }
 
     msg_send_rsp_ok();
 }
 
-void do_mouse_start_request(uint32_t x_max, uint32_t y_max)
-{
-    void *message = NULL;
-    mouse_start_data_t data;
-
-    debug_printf("Sending mouse start message!\n");
-
-    data.x_max = x_max;
-    data.y_max = y_max;
-
-    msg_create(&message, REQ_MOUSE_START, &data, sizeof(data));
-    msg_send(message);
-    msg_destroy(message);
-
-    msg_receive_rsp_ok();
-}
-
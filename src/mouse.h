@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "device.h"
 
 typedef struct
 {
@@ -36,22 +37,20 @@ typedef struct
     uint32_t y_max;
 } mouse_start_data_t;
 
-int mouse_create(int x, int y);
-void mouse_destroy(void);
-bool mouse_online(void);
-const char* mouse_sys_name(void);
-void mouse_move(int x_rel, int y_rel);
-void do_mouse_click(void *message);
-void do_mouse_click_request(int button);
-void do_mouse_down(void *message);
-void do_mouse_down_request(int button);
-void do_mouse_up(void *message);
-void do_mouse_up_request(int button);
-void do_mouse_scroll(void *message);
-void do_mouse_scroll_request(int32_t ticks);
-void do_mouse_move(void *message);
-void do_mouse_move_request(int32_t x, int32_t y);
-void do_mouse_start_request(uint32_t x_max, uint32_t y_max);
+int mouse_create(unsigned int id, int x_max, int y_max);
+void mouse_move(input_device_t *mouse, int x_rel, int y_rel);
+void mouse_press(input_device_t *mouse, int button);
+void mouse_release(input_device_t *mouse, int button);
+void mouse_scroll(input_device_t *mouse, int32_t ticks);
+int do_mouse_click(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay);
+int do_mouse_click_request(int button);
+int do_mouse_down(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay);
+int do_mouse_down_request(int button);
+int do_mouse_up(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay);
+int do_mouse_up_request(int button);
+int do_mouse_scroll(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay);
+int do_mouse_scroll_request(int32_t ticks);
+int do_mouse_move(input_device_t *mouse, void *message, uint32_t step, uint32_t *delay);
+int do_mouse_move_request(int32_t x, int32_t y);
+int do_mouse_start_request(uint32_t x_max, uint32_t y_max);
 void do_mouse_start(void *message);
-int mouse_x_max(void);
-int mouse_y_max(void);
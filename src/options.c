@@ -21,7 +21,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <getopt.h>
+#include <sched.h>
 #include <uchar.h>
 #include <wchar.h>
 #include <linux/uinput.h>
@@ -31,11 +34,18 @@
 #include "print.h"
 #include "misc.h"
 #include "keyboard.h"
+#include "device.h"
+#include "message.h"
+#include "layout.h"
+#include "timer.h"
 
 option_t option =
 {
     .command = CMD_NONE,
     .device = DEV_NONE,
+    .count = 1,
+    .id = -1,
+    .async = false,
     .x_max = 1024,
     .y_max = 768,
     .slots = 4,
@@ -50,37 +60,62 @@ option_t option =
     .x = -1,
     .y = -1,
     .duration = 15,
+    .job_action = JOB_ACTION_NONE,
+    .job_id = 0,
     .daemonize = true,
+    .backlog = 16,
+    .spin = 0,
+    .realtime = false,
+    .cpu = -1,
+    .script = NULL,
     .wc_string = NULL,
+    .instance = NULL,
+    .layout = NULL,
 };
 
 void options_help_print(void)
 {
-    printf("Usage: input-emulator [--version] [--help] <command> [<arguments>]\n");
+    printf("Usage: input-emulator [--version] [--help] [--instance <name>] <command> [<arguments>]\n");
     printf("\n");
     printf("  -v, --version                      Display version\n");
     printf("  -h, --help                         Display help\n");
+    printf("      --instance <name>              Select service instance (default: $INPUT_EMULATOR_INSTANCE)\n");
     printf("\n");
     printf("Available commands:\n");
-    printf("  start [<options>] kbd|mouse|touch  Create virtual input device\n");
-    printf("  kbd <action> <args>                Do keyboard action\n");
-    printf("  mouse <action> <args>              Do mouse action\n");
-    printf("  touch <action> <args>              Do touch action\n");
+    printf("  start [<options>] kbd|mouse|touch  Create virtual input device(s)\n");
+    printf("  kbd [--id <id>] <action> <args>    Do keyboard action\n");
+    printf("  mouse [--id <id>] <action> <args>  Do mouse action\n");
+    printf("  touch [--id <id>] <action> <args>  Do touch action\n");
     printf("  status                             Show status of virtual input devices\n");
-    printf("  stop kbd|mouse|touch|all           Destroy virtual input device\n");
+    printf("  run <file>|-                       Run script of commands from file or stdin\n");
+    printf("  stop [--id <id>] kbd|mouse|touch|all\n");
+    printf("                                     Destroy virtual input device(s)\n");
+    printf("  job <action> <id>|all              Do job action\n");
     printf("\n");
     printf("Start options:\n");
     printf("  -x, --x-max <points>               Maximum x-coordinate (only for mouse and touch)\n");
     printf("  -y, --y-max <points>               Maximum y-coordinate (only for mouse and touch)\n");
     printf("  -s, --slots <number>               Maximum number of slots (fingers) recognized (only for touch)\n");
     printf("  -d, --type-delay <ms>              Type delay (only for keyboard, default: %d)\n", option.type_delay);
+    printf("  -l, --layout <name>                Keyboard layout (only for keyboard, default: %s)\n", LAYOUT_DEFAULT);
     printf("  -n, --no-daemonize                 Run in foreground\n");
+    printf("  -b, --backlog <number>             Maximum number of pending client connections (default: %d)\n", option.backlog);
+    printf("  -c, --count <number>               Number of devices of each type (default: 1)\n");
+    printf("      --spin <us>                    Busy-wait last microseconds of delays (default: %d)\n", option.spin);
+    printf("  -r, --realtime                     Run service with real-time priority and locked memory\n");
+    printf("      --cpu <cpu>                    Run service on given CPU only\n");
+    printf("\n");
+    printf("Device options:\n");
+    printf("  -i, --id <id>                      Device id (default: 0, stop: all)\n");
+    printf("  -a, --async                        Print job id instead of waiting for action\n");
     printf("\n");
     printf("Keyboard actions:\n");
     printf("  type <string>                      Type string\n");
+    printf("  type --file <path>                 Type UTF-8 text of file\n");
     printf("  key <key>                          Stroke key (press and release)\n");
     printf("  keydown <key>                      Press key\n");
     printf("  keyup <key>                        Release key\n");
+    printf("  layout <name>                      Switch keyboard layout\n");
     printf("\n");
     printf("Mouse actions:\n");
     printf("  move <x> <y>                       Move mouse x,y relative\n");
@@ -92,6 +127,11 @@ void options_help_print(void)
     printf("Touch actions:\n");
     printf("  tap <x> <y>                        Tap at x,y coordinate\n");
     printf("\n");
+    printf("Job actions:\n");
+    printf("  status <id>                        Show state of job\n");
+    printf("  wait <id>                          Wait for job to finish and show its state\n");
+    printf("  cancel <id>|all                    Cancel job, releasing any keys, buttons, contacts held\n");
+    printf("\n");
 }
 
 void options_version_print(void)
@@ -99,8 +139,68 @@ void options_version_print(void)
     printf("input-emulator v%s\n", VERSION);
 }
 
+/* Parse decimal number of option. Fails unless whole text is a number in
+ * range min..max. */
+static int option_number_parse(const char *text, long min, long max, long *value)
+{
+    char *end;
+
+    errno = 0;
+    *value = strtol(text, &end, 10);
+    if ((errno != 0) || (end == text) || (*end != 0) || (*value < min) || (*value > max))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Parse options of device commands (kbd, mouse, touch, stop) */
+static void options_parse_device(int argc, char *argv[])
+{
+    int option_index = 0;
+    int c;
+
+    static struct option long_options[] =
+    {
+        {"id",             required_argument, 0, 'i'},
+        {"async",          no_argument,       0, 'a'},
+        {0,                0,                 0,  0 }
+    };
+
+    /* Reinitialize getopt_long to honor the '+' below */
+    optind = 0;
+
+    do
+    {
+        /* Stop at first non-option (the action) */
+        c = getopt_long(argc, argv, "+i:a", long_options, &option_index);
+
+        switch (c)
+        {
+            case 'i':
+                option.id = atoi(optarg);
+                if ((option.id < 0) || (option.id >= DEVICE_ID_MAX))
+                {
+                    error_printf("Device id must be 0..%d\n", DEVICE_ID_MAX - 1);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'a':
+                option.async = true;
+                break;
+
+            case '?':
+                exit(EXIT_FAILURE);
+        }
+    } while (c != -1);
+}
+
 void options_parse(int argc, char *argv[])
 {
+    char *command;
+    long number;
     int c;
 
     /* Print help if no arguments */
@@ -113,10 +213,59 @@ void options_parse(int argc, char *argv[])
     /* getopt_long stores the option index here */
     int option_index = 0;
 
+    static struct option global_options[] =
+    {
+        {"version",        no_argument,       0, 'v'},
+        {"help",           no_argument,       0, 'h'},
+        {"instance",       required_argument, 0, 'I'},
+        {0,                0,                 0,  0 }
+    };
+
+    /* Parse global options preceding the command */
+    optind = 0;
+
+    do
+    {
+        c = getopt_long(argc, argv, "+vh", global_options, &option_index);
+
+        switch (c)
+        {
+            case 'v':
+                options_version_print();
+                exit(EXIT_SUCCESS);
+
+            case 'h':
+                options_help_print();
+                exit(EXIT_SUCCESS);
+
+            case 'I':
+                option.instance = optarg;
+                break;
+
+            case '?':
+                exit(EXIT_FAILURE);
+        }
+    } while (c != -1);
+
+    if (optind == argc)
+    {
+        error_printf("Please specify <command>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Parse remaining arguments with command in place of program name. This
+     * way getopt_long can be reinitialized (optind = 0) for each command
+     * specific pass, which then starts right after the command. Setting
+     * optind to anything else keeps the ordering mode of the first pass. */
+    command = argv[optind];
+    argv[optind] = argv[0];
+    argc -= optind;
+    argv += optind;
+
     /* Skip ahead past command */
-    optind = 2;
+    optind = 1;
 
-    if (strcmp(argv[1], "start") == 0)
+    if (strcmp(command, "start") == 0)
     {
         option.command = CMD_START;
 
@@ -126,14 +275,22 @@ void options_parse(int argc, char *argv[])
             {"y-max",          required_argument, 0, 'y'},
             {"slots",          required_argument, 0, 's'},
             {"type-delay",     required_argument, 0, 'd'},
+            {"layout",         required_argument, 0, 'l'},
             {"no-daemonize",   no_argument,       0, 'n'},
+            {"backlog",        required_argument, 0, 'b'},
+            {"count",          required_argument, 0, 'c'},
+            {"spin",           required_argument, 0, 'P'},
+            {"realtime",       no_argument,       0, 'r'},
+            {"cpu",            required_argument, 0, 'C'},
             {0,                0,                 0,  0 }
         };
 
+        optind = 0;
+
         do
         {
             /* Parse start options */
-            c = getopt_long(argc, argv, "x:y:s:d:n", long_options, &option_index);
+            c = getopt_long(argc, argv, "x:y:s:d:l:nb:c:r", long_options, &option_index);
 
             switch (c)
             {
@@ -153,22 +310,68 @@ void options_parse(int argc, char *argv[])
                     option.type_delay = atoi(optarg);
                     break;
 
+                case 'l':
+                    option.layout = optarg;
+                    break;
+
                 case 'n':
                     option.daemonize = false;
                     break;
 
+                case 'b':
+                    if (option_number_parse(optarg, 1, INT_MAX, &number) < 0)
+                    {
+                        error_printf("Invalid backlog %s\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                    option.backlog = number;
+                    break;
+
+                case 'c':
+                    option.count = atoi(optarg);
+                    if ((option.count < 1) || (option.count > DEVICE_ID_MAX))
+                    {
+                        error_printf("Device count must be 1..%d\n", DEVICE_ID_MAX);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case 'P':
+                    if (option_number_parse(optarg, 0, TIMER_SPIN_US_MAX, &number) < 0)
+                    {
+                        error_printf("Spin must be 0..%d us\n", TIMER_SPIN_US_MAX);
+                        exit(EXIT_FAILURE);
+                    }
+                    option.spin = number;
+                    break;
+
+                case 'r':
+                    option.realtime = true;
+                    break;
+
+                case 'C':
+                    option.cpu = atoi(optarg);
+                    if ((option.cpu < 0) || (option.cpu >= CPU_SETSIZE))
+                    {
+                        error_printf("Invalid CPU %s\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
                 case '?':
                     exit(EXIT_FAILURE);
             }
         } while (c != -1);
     }
-    else if (strcmp(argv[1], "stop") == 0)
+    else if (strcmp(command, "stop") == 0)
     {
         option.command = CMD_STOP;
+        options_parse_device(argc, argv);
     }
-    else if (strcmp(argv[1], "kbd") == 0)
+    else if (strcmp(command, "kbd") == 0)
     {
         option.command = CMD_KBD;
+        options_parse_device(argc, argv);
 
         if (optind != argc)
         {
@@ -177,7 +380,20 @@ void options_parse(int argc, char *argv[])
                 debug_printf("type!\n");
                 option.kbd_action = KBD_TYPE;
                 optind++;
-                if (optind != argc)
+                if ((optind != argc) && (strcmp(argv[optind], "--file") == 0))
+                {
+                    option.kbd_action = KBD_TYPE_FILE;
+                    optind++;
+                    if (optind == argc)
+                    {
+                        error_printf("Please specify type --file <path>\n");
+                        exit(EXIT_FAILURE);
+                    }
+
+                    option.string = strdup(argv[optind]);
+                    optind++;
+                }
+                else if (optind != argc)
                 {
                     option.string = strdup(argv[optind]);
                     option.wc_string = convert_mbs_to_wcs(argv[optind]);
@@ -194,7 +410,11 @@ void options_parse(int argc, char *argv[])
                 if (optind != argc)
                 {
                     option.wc_string = convert_mbs_to_wcs(argv[optind]);
-                    wchar_or_alias_to_key(option.wc_string, &option.key);
+                    if (wchar_or_alias_to_key(option.wc_string, &option.key) < 0)
+                    {
+                        error_printf("Invalid key '%s'\n", argv[optind]);
+                        exit(EXIT_FAILURE);
+                    }
 
                     optind++;
                 }
@@ -207,7 +427,11 @@ void options_parse(int argc, char *argv[])
                 if (optind != argc)
                 {
                     option.wc_string = convert_mbs_to_wcs(argv[optind]);
-                    wchar_or_alias_to_key(option.wc_string, &option.key);
+                    if (wchar_or_alias_to_key(option.wc_string, &option.key) < 0)
+                    {
+                        error_printf("Invalid key '%s'\n", argv[optind]);
+                        exit(EXIT_FAILURE);
+                    }
 
                     optind++;
                 }
@@ -220,59 +444,118 @@ void options_parse(int argc, char *argv[])
                 if (optind != argc)
                 {
                     option.wc_string = convert_mbs_to_wcs(argv[optind]);
-                    wchar_or_alias_to_key(option.wc_string, &option.key);
+                    if (wchar_or_alias_to_key(option.wc_string, &option.key) < 0)
+                    {
+                        error_printf("Invalid key '%s'\n", argv[optind]);
+                        exit(EXIT_FAILURE);
+                    }
 
                     optind++;
                 }
             }
+            else if (strcmp(argv[optind], "layout") == 0)
+            {
+                option.kbd_action = KBD_LAYOUT;
+                optind++;
+                if (optind == argc)
+                {
+                    error_printf("Please specify layout name\n");
+                    exit(EXIT_FAILURE);
+                }
+
+                option.layout = argv[optind];
+                optind++;
+            }
         }
     }
-    else if (strcmp(argv[1], "mouse") == 0)
+    else if (strcmp(command, "mouse") == 0)
     {
         option.command = CMD_MOUSE;
+        options_parse_device(argc, argv);
 
     }
-    else if (strcmp(argv[1], "touch") == 0)
+    else if (strcmp(command, "touch") == 0)
     {
         option.command = CMD_TOUCH;
+        options_parse_device(argc, argv);
 
     }
-    else if (strcmp(argv[1], "status") == 0)
+    else if (strcmp(command, "status") == 0)
     {
         option.command = CMD_STATUS;
 
     }
-    else
+    else if (strcmp(command, "run") == 0)
     {
-        // No command provided so we restore index
-        optind = 1;
+        option.command = CMD_RUN;
 
-        static struct option long_options[] =
+        if (optind != argc)
         {
-            {"version",        no_argument,       0, 'v'},
-            {"help",           no_argument,       0, 'h'},
-            {0,                0,                 0,  0 }
-        };
+            option.script = argv[optind];
+            optind++;
+        }
+        else
+        {
+            error_printf("Please specify run <file>\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (strcmp(command, "job") == 0)
+    {
+        option.command = CMD_JOB;
 
-        do
+        if (optind != argc)
         {
-            /* Parse options */
-            c = getopt_long(argc, argv, "vh", long_options, &option_index);
+            if (strcmp(argv[optind], "status") == 0)
+            {
+                option.job_action = JOB_ACTION_STATUS;
+            }
+            else if (strcmp(argv[optind], "wait") == 0)
+            {
+                option.job_action = JOB_ACTION_WAIT;
+            }
+            else if (strcmp(argv[optind], "cancel") == 0)
+            {
+                option.job_action = JOB_ACTION_CANCEL;
+            }
 
-            switch (c)
+            if (option.job_action != JOB_ACTION_NONE)
             {
-                case 'v':
-                    options_version_print();
-                    exit(EXIT_SUCCESS);
+                optind++;
+            }
+        }
 
-                case 'h':
-                    options_help_print();
-                    exit(EXIT_SUCCESS);
+        if (option.job_action == JOB_ACTION_NONE)
+        {
+            error_printf("Please specify job <action>\n");
+            exit(EXIT_FAILURE);
+        }
 
-                case '?':
-                    exit(EXIT_FAILURE);
+        if (optind == argc)
+        {
+            error_printf("Please specify job id\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if ((option.job_action == JOB_ACTION_CANCEL) && (strcmp(argv[optind], "all") == 0))
+        {
+            option.job_id = MSG_JOB_ID_ALL;
+        }
+        else
+        {
+            option.job_id = strtoul(argv[optind], NULL, 0);
+            if (option.job_id == MSG_JOB_ID_ALL)
+            {
+                error_printf("Invalid job id '%s'\n", argv[optind]);
+                exit(EXIT_FAILURE);
             }
-        } while (c != -1);
+        }
+        optind++;
+    }
+    else
+    {
+        // Unknown command so we restore index
+        optind = 0;
     }
 
     if ((option.command == CMD_NONE) && (optind != argc))
@@ -281,7 +564,33 @@ void options_parse(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    if ((option.command == CMD_START) || (option.command == CMD_STOP))
+    if (option.command == CMD_START)
+    {
+        /* One or more devices */
+        while (optind != argc)
+        {
+            if (strcmp(argv[optind],"kbd") == 0)
+            {
+                option.device = DEV_KEYBOARD;
+            }
+            else if (strcmp(argv[optind],"mouse") == 0)
+            {
+                option.device = DEV_MOUSE;
+            }
+            else if (strcmp(argv[optind],"touch") == 0)
+            {
+                option.device = DEV_TOUCH;
+            }
+            else
+            {
+                break;
+            }
+            option.devices |= DEVICE_BIT(option.device);
+            optind++;
+        }
+    }
+
+    if (option.command == CMD_STOP)
     {
         if (optind != argc)
         {
@@ -302,14 +611,14 @@ void options_parse(int argc, char *argv[])
             }
             else if (strcmp(argv[optind],"all") == 0)
             {
-                if (option.command == CMD_STOP)
-                {
-                    option.device = DEV_ALL;
-                    optind++;
-                }
+                option.device = DEV_ALL;
+                optind++;
             }
         }
+    }
 
+    if ((option.command == CMD_START) || (option.command == CMD_STOP))
+    {
         if (option.device == DEV_NONE)
         {
             if (option.command == CMD_START)
@@ -32,6 +32,8 @@ typedef enum
     CMD_MOUSE,
     CMD_TOUCH,
     CMD_STATUS,
+    CMD_RUN,
+    CMD_JOB,
     CMD_NONE
 } command_t;
 
@@ -44,12 +46,17 @@ typedef enum
     DEV_NONE,
 } device_t;
 
+/* Bit of device in device mask */
+#define DEVICE_BIT(device) (1U << (device))
+
 typedef enum
 {
     KBD_KEY,
     KBD_KEYDOWN,
     KBD_KEYUP,
     KBD_TYPE,
+    KBD_TYPE_FILE,
+    KBD_LAYOUT,
     KBD_NONE,
 } kbd_action_t;
 
@@ -69,18 +76,35 @@ typedef enum
     TOUCH_NONE,
 } touch_action_t;
 
+typedef enum
+{
+    JOB_ACTION_STATUS,
+    JOB_ACTION_WAIT,
+    JOB_ACTION_CANCEL,
+    JOB_ACTION_NONE,
+} job_action_t;
+
 typedef struct
 {
     command_t command;
     device_t device;
+    unsigned int devices;
+    unsigned int count;
+    int id;
+    bool async;
     uint32_t x_max;
     uint32_t y_max;
     int slots;
     kbd_action_t kbd_action;
     char *string;
     wchar_t *wc_string;
+    char *instance;
+    char *layout;
     uint32_t key;
     uint32_t type_delay;
+    uint32_t spin;
+    bool realtime;
+    int cpu;
     mouse_action_t mouse_action;
     int32_t ticks;
     int button;
@@ -88,7 +112,11 @@ typedef struct
     int32_t x;
     int32_t y;
     uint32_t duration;
+    job_action_t job_action;
+    uint32_t job_id;
     bool daemonize;
+    int backlog;
+    char *script;
 } option_t;
 
 extern option_t option;
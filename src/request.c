@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <wchar.h>
+#include <sys/stat.h>
+#include "message.h"
+#include "batch.h"
+#include "keyboard.h"
+#include "keymap.h"
+#include "keyname.h"
+#include "mouse.h"
+#include "touch.h"
+#include "service.h"
+#include "print.h"
+#include "misc.h"
+
+#define BATCH_SIZE_MIN 64
+
+void batch_init(batch_t *batch)
+{
+    batch->ops = NULL;
+    batch->count = 0;
+    batch->size = 0;
+}
+
+int batch_add(batch_t *batch, batch_op_type_t type, int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    batch_op_t *op;
+
+    /* Grow operation array as needed */
+    if (batch->count == batch->size)
+    {
+        uint32_t size = batch->size ? batch->size * 2 : BATCH_SIZE_MIN;
+
+        op = realloc(batch->ops, size * sizeof(batch_op_t));
+        if (op == NULL)
+        {
+            error_printf("realloc() failed (%s)\n", strerror(errno));
+            return -ENOMEM;
+        }
+        batch->ops = op;
+        batch->size = size;
+    }
+
+    op = &batch->ops[batch->count++];
+    op->type = type;
+    op->arg[0] = arg0;
+    op->arg[1] = arg1;
+    op->arg[2] = arg2;
+
+    return 0;
+}
+
+void batch_clear(batch_t *batch)
+{
+    batch->count = 0;
+}
+
+void batch_free(batch_t *batch)
+{
+    free(batch->ops);
+    batch_init(batch);
+}
+
+int do_batch_request(batch_t *batch)
+{
+    debug_printf("Sending batch of %u operations\n", batch->count);
+
+    return msg_request(REQ_BATCH, batch->ops, batch->count * sizeof(batch_op_t));
+}
+
+int wchar_to_key(wchar_t wc, uint32_t *key, uint32_t *modifier)
+{
+    /* Keys given by character on the command-line use the built in layout */
+    return keymap_lookup(keymap_builtin(), wc, key, modifier);
+}
+
+/* Key given by character or by name (KEY_*, BTN_* or alias) */
+int wchar_or_alias_to_key(const wchar_t *wcs, uint32_t *key)
+{
+    char name[KEYNAME_LENGTH_MAX];
+    uint32_t modifier;
+    size_t i;
+
+    if (wcslen(wcs) == 1)
+    {
+        return wchar_to_key(wcs[0], key, &modifier);
+    }
+
+    /* Key names are ASCII */
+    for (i = 0; wcs[i] != 0; i++)
+    {
+        if ((wcs[i] > 0x7f) || (i == (KEYNAME_LENGTH_MAX - 1)))
+        {
+            return -1;
+        }
+        name[i] = wcs[i];
+    }
+    name[i] = 0;
+
+    return keyname_lookup(name, key);
+}
+
+int do_keyboard_start_request(uint32_t type_delay)
+{
+    keyboard_start_data_t data;
+
+    debug_printf("Sending keyboard start message!\n");
+
+    data.type_delay = type_delay;
+
+    return msg_request(REQ_KBD_START, &data, sizeof(data));
+}
+
+int do_keyboard_keydown_request(uint32_t key)
+{
+    return msg_request(REQ_KBD_KEYDOWN, &key, sizeof(key));
+}
+
+int do_keyboard_keyup_request(uint32_t key)
+{
+    return msg_request(REQ_KBD_KEYUP, &key, sizeof(key));
+}
+
+int do_keyboard_key_request(uint32_t key)
+{
+    return msg_request(REQ_KBD_KEY, &key, sizeof(key));
+}
+
+/* Text is sent as UTF-8 in requests of at most KEYBOARD_TYPE_CHUNK_SIZE
+ * bytes, queued as consecutive jobs of the keyboard. Typing starts with the
+ * first chunk while later chunks are still being sent. The response to each
+ * chunk acknowledges that it has been typed, and at most
+ * KEYBOARD_TYPE_CHUNKS_AHEAD chunks are sent ahead of it. Asynchronous
+ * chunks are responded once queued instead, and chunks after the first
+ * continue its job so that the job id covers all of the text. */
+int do_keyboard_type_request(const wchar_t *wc_string)
+{
+    const size_t size = KEYBOARD_TYPE_CHUNK_SIZE;
+    uint32_t pending = 0;
+    uint32_t length;
+    char *chunk;
+    int status = 0;
+    int result;
+
+    chunk = malloc(size);
+    if (chunk == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    do
+    {
+        /* Encode as many characters as fit in chunk */
+        length = 0;
+        while ((*wc_string != 0) && ((length + UTF8_LENGTH_MAX) <= size))
+        {
+            length += utf8_encode(*wc_string++, chunk + length);
+        }
+
+        // Dump data sent
+        debug_printf("Dumping send payload:\n");
+        debug_print_hex_dump(chunk, length);
+
+        status = msg_request_send(REQ_KBD_TYPE, chunk, length);
+        if (status < 0)
+        {
+            break;
+        }
+        pending++;
+        message_client_job_continue(true);
+
+        if (pending == KEYBOARD_TYPE_CHUNKS_AHEAD)
+        {
+            status = msg_receive_rsp_ok();
+            pending--;
+            debug_printf("Chunk typed (%u pending)\n", pending);
+        }
+    }
+    while ((status == 0) && (*wc_string != 0));
+
+    /* Collect responses of chunks in flight */
+    while (pending--)
+    {
+        result = msg_receive_rsp_ok();
+        debug_printf("Chunk typed (%u pending)\n", pending);
+        if (status == 0)
+        {
+            status = result;
+        }
+        if ((result < 0) && (result != -EIO))
+        {
+            /* Connection failed */
+            break;
+        }
+    }
+
+    message_client_job_continue(false);
+    free(chunk);
+
+    return status;
+}
+
+/* The file is opened by the client and passed to the service, which reads
+ * and types it directly */
+int do_keyboard_type_file_request(const char *path)
+{
+    struct stat st;
+    int status;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        status = -errno;
+        error_printf("Could not open %s (%s)\n", path, strerror(errno));
+        return status;
+    }
+
+    /* Reading must not block the service */
+    if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode))
+    {
+        error_printf("%s is not a regular file\n", path);
+        close(fd);
+        return -EINVAL;
+    }
+
+    status = msg_request_fd(REQ_KBD_TYPE_FILE, NULL, 0, fd);
+    close(fd);
+
+    return status;
+}
+
+int do_keyboard_layout_request(const char *name)
+{
+    keyboard_layout_data_t data;
+
+    if (strlen(name) >= sizeof(data.name))
+    {
+        return -EINVAL;
+    }
+
+    memset(&data, 0, sizeof(data));
+    strcpy(data.name, name);
+
+    return msg_request(REQ_KBD_LAYOUT, &data, sizeof(data));
+}
+
+int do_mouse_start_request(uint32_t x_max, uint32_t y_max)
+{
+    mouse_start_data_t data;
+
+    debug_printf("Sending mouse start message!\n");
+
+    data.x_max = x_max;
+    data.y_max = y_max;
+
+    return msg_request(REQ_MOUSE_START, &data, sizeof(data));
+}
+
+int do_mouse_move_request(int32_t x, int32_t y)
+{
+    mouse_move_data_t mouse_move_data;
+
+    mouse_move_data.x = x;
+    mouse_move_data.y = y;
+
+    return msg_request(REQ_MOUSE_MOVE, &mouse_move_data, sizeof(mouse_move_data_t));
+}
+
+int do_mouse_click_request(int button)
+{
+    return msg_request(REQ_MOUSE_BUTTON, &button, sizeof(button));
+}
+
+int do_mouse_down_request(int button)
+{
+    return msg_request(REQ_MOUSE_BUTTONDOWN, &button, sizeof(button));
+}
+
+int do_mouse_up_request(int button)
+{
+    return msg_request(REQ_MOUSE_BUTTONUP, &button, sizeof(button));
+}
+
+int do_mouse_scroll_request(int32_t ticks)
+{
+    return msg_request(REQ_MOUSE_SCROLL, &ticks, sizeof(ticks));
+}
+
+int do_touch_start_request(uint32_t x_max, uint32_t y_max, uint8_t slots)
+{
+    touch_start_data_t data;
+
+    data.x_max = x_max;
+    data.y_max = y_max;
+    data.slots = slots;
+
+    return msg_request(REQ_TOUCH_START, &data, sizeof(data));
+}
+
+int do_touch_tap_request(uint32_t x, uint32_t y, uint32_t duration)
+{
+    touch_tap_data_t touch_tap_data;
+
+    debug_printf("Sending tap message!\n");
+
+    touch_tap_data.x = x;
+    touch_tap_data.y = y;
+    touch_tap_data.duration = duration;
+
+    return msg_request(REQ_TOUCH_TAP, &touch_tap_data, sizeof(touch_tap_data_t));
+}
+
+int do_service_stop_request(device_t device)
+{
+    debug_printf("Sending stop message!\n");
+
+    return msg_request(REQ_STOP, &device, sizeof(device));
+}
+
+int do_service_status_request(char *text, size_t size)
+{
+    void *message = NULL;
+    message_header_t *header;
+    uint32_t length;
+    int status;
+
+    status = msg_create(&message, REQ_STATUS, NULL, 0);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    status = msg_send(message);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    // Receive response
+    status = msg_receive(&message);
+    if (status < 0)
+    {
+        error_printf("No response from service\n");
+        return status;
+    }
+    header = message;
+    if (header->type != RSP_STATUS)
+    {
+        warning_printf("Invalid message type received\n");
+        return -EPROTO;
+    }
+
+    /* Status text is not zero terminated on the wire */
+    length = header->payload_length;
+    if (length >= size)
+    {
+        length = size - 1;
+    }
+    memcpy(text, message + sizeof(message_header_t), length);
+    text[length] = 0;
+
+    return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "script.h"
+#include "options.h"
+#include "message.h"
+#include "print.h"
+#include "input-emulator.h"
+
+#define SCRIPT_ARGS_MAX 32
+
+/* Split line into arguments in place. Supports single quotes, double
+ * quotes, backslash escapes and comments starting with '#'. */
+static int script_tokenize(char *line, char *argv[], int argc_max)
+{
+    char *read_p = line;
+    char *write_p = line;
+    int argc = 0;
+
+    while (*read_p)
+    {
+        char quote = 0;
+
+        /* Skip white space between arguments */
+        while ((*read_p == ' ') || (*read_p == '\t') || (*read_p == '\n') || (*read_p == '\r'))
+        {
+            read_p++;
+        }
+
+        if ((*read_p == 0) || (*read_p == '#'))
+        {
+            break;
+        }
+
+        if (argc == argc_max)
+        {
+            return -1;
+        }
+        argv[argc++] = write_p;
+
+        /* Copy argument while removing quotes and escapes */
+        while (*read_p)
+        {
+            if (quote)
+            {
+                if (*read_p == quote)
+                {
+                    quote = 0;
+                    read_p++;
+                    continue;
+                }
+                if ((quote == '"') && (*read_p == '\\') && (read_p[1] != 0))
+                {
+                    read_p++;
+                }
+            }
+            else
+            {
+                if ((*read_p == ' ') || (*read_p == '\t') || (*read_p == '\n') || (*read_p == '\r'))
+                {
+                    read_p++;
+                    break;
+                }
+                if ((*read_p == '"') || (*read_p == '\''))
+                {
+                    quote = *read_p++;
+                    continue;
+                }
+                if ((*read_p == '\\') && (read_p[1] != 0))
+                {
+                    read_p++;
+                }
+            }
+            *write_p++ = *read_p++;
+        }
+
+        if (quote)
+        {
+            /* Unterminated quote */
+            return -1;
+        }
+
+        *write_p++ = 0;
+    }
+
+    return argc;
+}
+
+static void script_sleep(double seconds)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) seconds;
+    ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1000000000);
+
+    while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR))
+    {
+    }
+}
+
+int script_run(const char *filename, void (*callback)(void))
+{
+    const option_t option_defaults = option;
+    message_sync_data_t sync;
+    char *argv[SCRIPT_ARGS_MAX + 1];
+    char *line = NULL;
+    size_t line_size = 0;
+    int line_number = 0;
+    int status = 0;
+    bool batch = false;
+    FILE *file;
+    int argc;
+
+    if (strcmp(filename, "-") == 0)
+    {
+        file = stdin;
+    }
+    else
+    {
+        file = fopen(filename, "r");
+        if (file == NULL)
+        {
+            error_printf("Could not open %s (%s)\n", filename, strerror(errno));
+            return -1;
+        }
+    }
+
+    /* Requests of all script lines are sent over the same connection
+     * without waiting for each to be acknowledged */
+    message_client_pipeline_enable();
+
+    while (getline(&line, &line_size, file) >= 0)
+    {
+        line_number++;
+
+        /* Arguments of line are parsed as if given on the command-line */
+        argv[0] = "input-emulator";
+        argc = script_tokenize(line, &argv[1], SCRIPT_ARGS_MAX);
+        if (argc < 0)
+        {
+            error_printf("%s:%d: Invalid line\n", filename, line_number);
+            status = -1;
+            break;
+        }
+        if (argc == 0)
+        {
+            continue;
+        }
+        argc++;
+
+        if (strcmp(argv[1], "batch") == 0)
+        {
+            if ((argc != 3) ||
+                ((strcmp(argv[2], "begin") != 0) && (strcmp(argv[2], "end") != 0)))
+            {
+                error_printf("%s:%d: Please specify batch begin|end\n", filename, line_number);
+                status = -1;
+                break;
+            }
+
+            /* Actions between begin and end are sent as a single request */
+            if (strcmp(argv[2], "begin") == 0)
+            {
+                if (batch)
+                {
+                    error_printf("%s:%d: Batch already begun\n", filename, line_number);
+                    status = -1;
+                    break;
+                }
+                input_emulator_batch_begin();
+                batch = true;
+            }
+            else
+            {
+                if (!batch)
+                {
+                    error_printf("%s:%d: No batch begun\n", filename, line_number);
+                    status = -1;
+                    break;
+                }
+                batch = false;
+                if (input_emulator_batch_end() < 0)
+                {
+                    status = -1;
+                }
+            }
+            continue;
+        }
+
+        if (strcmp(argv[1], "sleep") == 0)
+        {
+            if (argc != 3)
+            {
+                error_printf("%s:%d: Please specify sleep <seconds>\n", filename, line_number);
+                status = -1;
+                break;
+            }
+
+            /* Sleep is a delay between operations of batch */
+            if (batch)
+            {
+                if ((atof(argv[2]) < 0) || (input_emulator_batch_delay(atof(argv[2]) * 1000) < 0))
+                {
+                    error_printf("%s:%d: Invalid sleep\n", filename, line_number);
+                    status = -1;
+                    break;
+                }
+                continue;
+            }
+
+            /* Sleep relative to when previous commands have been performed */
+            if (do_message_sync_request(&sync) < 0)
+            {
+                status = -1;
+            }
+            script_sleep(atof(argv[2]));
+            continue;
+        }
+
+        if ((strcmp(argv[1], "kbd") != 0) &&
+            (strcmp(argv[1], "mouse") != 0) &&
+            (strcmp(argv[1], "touch") != 0) &&
+            (strcmp(argv[1], "status") != 0) &&
+            (strcmp(argv[1], "job") != 0) &&
+            (strcmp(argv[1], "stop") != 0))
+        {
+            error_printf("%s:%d: Unsupported command '%s'\n", filename, line_number, argv[1]);
+            status = -1;
+            break;
+        }
+
+        if (batch &&
+            (strcmp(argv[1], "kbd") != 0) &&
+            (strcmp(argv[1], "mouse") != 0) &&
+            (strcmp(argv[1], "touch") != 0))
+        {
+            error_printf("%s:%d: Command '%s' not possible in batch\n", filename, line_number, argv[1]);
+            status = -1;
+            break;
+        }
+
+        option = option_defaults;
+        options_parse(argc, argv);
+
+        callback();
+
+        free(option.string);
+        free(option.wc_string);
+    }
+
+    option = option_defaults;
+
+    if (batch && (status == 0))
+    {
+        error_printf("%s: Batch not ended\n", filename);
+        status = -1;
+    }
+
+    /* Wait for all requests to be performed */
+    if (do_message_sync_request(&sync) < 0)
+    {
+        status = -1;
+    }
+
+    free(line);
+    if (file != stdin)
+    {
+        fclose(file);
+    }
+
+    return status;
+}
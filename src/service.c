@@ -20,9 +20,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "config.h"
 #include "message.h"
 #include "options.h"
 #include "keyboard.h"
@@ -30,8 +40,10 @@
 #include "touch.h"
 #include "print.h"
 #include "misc.h"
+#include "service.h"
+#include "device.h"
 
-int device_ref_count = 0;
+atomic_int device_ref_count = 0;
 
 bool devices_online(void)
 {
@@ -48,13 +60,51 @@ bool service_running(void)
    return message_server_running();
 }
 
+/* Write end of the pipe used to tell the parent that the service is ready */
+static int ready_fd = -1;
+
+static void close_fds(unsigned int first, unsigned int last)
+{
+    if (first > last)
+    {
+        return;
+    }
+
+#ifdef HAVE_CLOSE_RANGE
+    if (close_range(first, last, 0) == 0)
+    {
+        return;
+    }
+#endif
+
+    /* Fall back to closing one by one */
+    long max = sysconf(_SC_OPEN_MAX);
+    for (long fd = first; (fd <= (long) last) && (fd < max); fd++)
+    {
+        close(fd);
+    }
+}
+
 void daemonize(void)
 {
     pid_t pid, sid;
+    int pipe_fd[2];
+    int status = EXIT_FAILURE;
+    ssize_t length;
+    int wstatus;
 
     /* Already a daemon */
     if ( getppid() == 1 ) return;
 
+    if (pipe2(pipe_fd, O_CLOEXEC) < 0)
+    {
+        error_printf("Failed to create pipe (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Do not let child inherit buffered output */
+    fflush(NULL);
+
     /* Fork off the parent process */
     pid = fork();
     if (pid < 0)
@@ -65,9 +115,19 @@ void daemonize(void)
     /* If we got a good PID, then we can exit the parent process. */
     if (pid > 0)
     {
-        /* Wait some time for everything to have been initialized */
-        sleep(3);
-        exit(EXIT_SUCCESS);
+        /* Wait for the child to report that it is ready. If the pipe is
+           closed without a status the child died, so use its exit status. */
+        close(pipe_fd[1]);
+        while (((length = read(pipe_fd[0], &status, sizeof(status))) < 0) && (errno == EINTR));
+        if (length != sizeof(status))
+        {
+            status = EXIT_FAILURE;
+            if ((waitpid(pid, &wstatus, 0) == pid) && WIFEXITED(wstatus))
+            {
+                status = WEXITSTATUS(wstatus);
+            }
+        }
+        exit(status);
     }
 
     /* At this point we are executing as the child process */
@@ -91,138 +151,221 @@ void daemonize(void)
         exit(EXIT_FAILURE);
     }
 
+    /* Close all open file descriptors except standard files and the write
+       end of the ready pipe */
+    close(pipe_fd[0]);
+    ready_fd = pipe_fd[1];
+    close_fds(3, ready_fd - 1);
+    close_fds(ready_fd + 1, ~0U);
 
-    /* Close all open file descriptors */
-    int x;
-    for (x = sysconf(_SC_OPEN_MAX); x>=0; x--)
+    /* Redirect standard input to /dev/null. Output is kept until the
+       service is ready so that start up errors are reported. */
+    freopen( "/dev/null", "r", stdin);
+}
+
+static void daemonize_ready(void)
+{
+    int status = EXIT_SUCCESS;
+
+    if (ready_fd < 0)
     {
-        debug_printf("Closing file descriptor %d\n", x);
-        close (x);
+        return;
     }
 
-    /* Redirect standard files to /dev/null */
-    freopen( "/dev/null", "r", stdin);
+    /* Redirect standard output files to /dev/null */
     freopen( "/dev/null", "w", stdout);
     freopen( "/dev/null", "w", stderr);
+
+    /* Release parent */
+    write(ready_fd, &status, sizeof(status));
+    close(ready_fd);
+    ready_fd = -1;
 }
 
-void do_service_stop(void *message)
+/* Send state to service manager (sd_notify protocol) if started with
+ * NOTIFY_SOCKET set */
+void service_notify(const char *state)
 {
-    message_header_t *header = message;
-    device_t *device = message + sizeof(message_header_t);
+    const char *path = getenv("NOTIFY_SOCKET");
+    struct sockaddr_un addr;
+    char text[128];
+    size_t length;
+    int fd;
 
-    if (header->payload_length != sizeof(device_t))
+    if ((path == NULL) || ((path[0] != '/') && (path[0] != '@')))
     {
-        warning_printf("Invalid payload length\n");
         return;
     }
 
-    switch(*device)
+    length = strlen(path);
+    if (length >= sizeof(addr.sun_path))
     {
-        case DEV_KEYBOARD:
-            keyboard_destroy();
-            break;
+        warning_printf("NOTIFY_SOCKET path too long\n");
+        return;
+    }
 
-        case DEV_MOUSE:
-            mouse_destroy();
-            break;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, length);
+    if (path[0] == '@')
+    {
+        addr.sun_path[0] = 0; // Abstract socket
+    }
 
-        case DEV_TOUCH:
-            touch_destroy();
-            break;
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        warning_printf("Could not create notify socket (%s)\n", strerror(errno));
+        return;
+    }
 
-        case DEV_ALL:
-            keyboard_destroy();
-            mouse_destroy();
-            touch_destroy();
-            break;
+    /* Main PID changes if we daemonized */
+    snprintf(text, sizeof(text), "%s\nMAINPID=%d", state, getpid());
 
-        case DEV_NONE:
-            break;
+    if (sendto(fd, text, strlen(text), MSG_NOSIGNAL, (struct sockaddr *) &addr,
+               offsetof(struct sockaddr_un, sun_path) + length) < 0)
+    {
+        warning_printf("Could not notify service manager (%s)\n", strerror(errno));
     }
 
-    msg_send_rsp_ok();
+    close(fd);
 }
 
-void do_service_stop_request(device_t device)
+/* Run service with real-time priority and memory locked so that delivery
+ * of events stays on time on a loaded host. Falls back to normal
+ * scheduling if not permitted. */
+void service_realtime_enable(void)
 {
-    void *message = NULL;
+    struct sched_param param;
+    char stack[SERVICE_STACK_PREFAULT];
 
-    debug_printf("Sending stop message!\n");
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = SERVICE_RT_PRIORITY;
 
-    msg_create(&message, REQ_STOP, &device, sizeof(device));
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+    {
+        warning_printf("Real-time scheduling not available (%s)\n", strerror(errno));
+    }
 
-    msg_send(message);
-    msg_destroy(message);
+    /* Avoid page faults while running */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        warning_printf("Could not lock memory (%s)\n", strerror(errno));
+        return;
+    }
 
-    msg_receive_rsp_ok();
+    /* Fault in stack pages up front */
+    memset(stack, 0, sizeof(stack));
+    __asm__ __volatile__("" : : "r" (stack) : "memory");
 }
 
-void do_service_status(void *message)
+/* Run service on given CPU only */
+void service_cpu_set(int cpu)
 {
-    char rsp_text[400];
-    char sys_path[] = "/sys/devices/virtual/input";
-    char *rsp_text_p = rsp_text;
+    cpu_set_t set;
 
-    sprintf(rsp_text_p, "Online devices:\n");
-    rsp_text_p += strlen(rsp_text_p);
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
 
-    if (keyboard_online())
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
     {
-        sprintf(rsp_text_p, "  kbd: %s/%s (type-delay: %u)\n",
-                sys_path,
-                keyboard_sys_name(),
-                keyboard_type_delay());
-        rsp_text_p += strlen(rsp_text_p);
+        warning_printf("Could not set CPU affinity to CPU %d (%s)\n", cpu, strerror(errno));
     }
+}
+
+static void service_notify_stopping(void)
+{
+    service_notify("STOPPING=1");
+}
+
+/* Report that the service is ready to accept requests */
+void service_ready(void)
+{
+    daemonize_ready();
+    service_notify("READY=1");
+    atexit(service_notify_stopping);
+}
+
+void do_service_stop(void *message)
+{
+    message_header_t *header = message;
+    device_t *device = message + sizeof(message_header_t);
 
-    if (mouse_online())
+    if (header->payload_length != sizeof(device_t))
     {
-        sprintf(rsp_text_p,
-                "mouse: %s/%s (x-max: %d y-max: %d)\n",
-                sys_path,
-                mouse_sys_name(),
-                mouse_x_max(),
-                mouse_y_max());
-        rsp_text_p += strlen(rsp_text_p);
+        warning_printf("Invalid payload length\n");
+        msg_send_rsp_error();
+        return;
     }
 
-    if (touch_online())
+    if (*device != DEV_NONE)
     {
-        sprintf(rsp_text_p,
-                "touch: %s/%s (x-max: %d y-max: %d slots: %d)\n",
-                sys_path,
-                touch_sys_name(),
-                touch_x_max(),
-                touch_y_max(),
-                touch_slots());
+        devices_destroy(*device, header->device_id);
     }
 
-    // Send response
-    msg_create(&message, RSP_STATUS, rsp_text, strlen(rsp_text));
-    msg_send(message);
-    msg_destroy(message);
+    msg_send_rsp_ok();
 }
 
-void do_service_status_request(void)
+void do_service_status(void *message)
 {
-    void *message = NULL;
-    message_header_t *header;
+    char rsp_text[STATUS_TEXT_LENGTH_MAX];
+    char sys_path[] = "/sys/devices/virtual/input";
+    size_t length = 0;
+    input_device_t *device;
 
-    msg_create(&message, REQ_STATUS, NULL, 0);
-    msg_send(message);
-    msg_destroy(message);
+    length += snprintf(rsp_text, sizeof(rsp_text), "Online devices:\n");
 
-    // Receive response
-    msg_receive(&message);
-    header = message;
-    if (header->type != RSP_STATUS)
+    for (device_t type = DEV_KEYBOARD; type < DEV_ALL; type++)
     {
-        warning_printf("Invalid message type received\n");
+        for (unsigned int id = 0; id < DEVICE_ID_MAX; id++)
+        {
+            device = device_lookup(type, id);
+            if ((device == NULL) || (length >= sizeof(rsp_text)))
+            {
+                continue;
+            }
+
+            switch (type)
+            {
+                case DEV_KEYBOARD:
+                    length += snprintf(rsp_text + length, sizeof(rsp_text) - length,
+                                       "  kbd: %s/%s (id: %u type-delay: %u layout: %s)\n",
+                                       sys_path,
+                                       device->sys_name,
+                                       id,
+                                       device->type_delay,
+                                       device->layout->name);
+                    break;
+
+                case DEV_MOUSE:
+                    length += snprintf(rsp_text + length, sizeof(rsp_text) - length,
+                                       "mouse: %s/%s (id: %u x-max: %d y-max: %d)\n",
+                                       sys_path,
+                                       device->sys_name,
+                                       id,
+                                       device->x_max,
+                                       device->y_max);
+                    break;
+
+                case DEV_TOUCH:
+                    length += snprintf(rsp_text + length, sizeof(rsp_text) - length,
+                                       "touch: %s/%s (id: %u x-max: %d y-max: %d slots: %d)\n",
+                                       sys_path,
+                                       device->sys_name,
+                                       id,
+                                       device->x_max,
+                                       device->y_max,
+                                       device->slots);
+                    break;
+
+                default:
+                    break;
+            }
+        }
     }
 
-    char *rsp_text = message + sizeof(message_header_t);
-
-    printf("%s", rsp_text);
-    msg_destroy(message);
+    // Send response
+    msg_create(&message, RSP_STATUS, rsp_text, strlen(rsp_text));
+    msg_send(message);
 }
+
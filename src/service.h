@@ -20,15 +20,30 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include <options.h>
 
-extern int device_ref_count;
+/* Maximum length of status text */
+#define STATUS_TEXT_LENGTH_MAX 4096
+
+/* SCHED_FIFO priority of service in real-time mode */
+#define SERVICE_RT_PRIORITY 50
+
+/* Stack faulted in when locking memory (bytes) */
+#define SERVICE_STACK_PREFAULT (64 * 1024)
+
+extern atomic_int device_ref_count;
 
 bool devices_online(void);
 bool service_running(void);
 void daemonize(void);
-void do_service_stop_request(device_t device);
+void service_notify(const char *state);
+void service_ready(void);
+void service_realtime_enable(void);
+void service_cpu_set(int cpu);
+int do_service_stop_request(device_t device);
 void do_service_stop(void *message);
-void do_service_status_request(void);
+int do_service_status_request(char *text, size_t size);
 void do_service_status(void *message);
 
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+#include "timer.h"
+#include "event.h"
+#include "print.h"
+
+#define TIMER_QUEUE_SIZE_MIN 64
+
+/* Binary min-heap of scheduled timers ordered by deadline */
+static timer_entry_t **queue = NULL;
+static int queue_count = 0;
+static int queue_size = 0;
+
+static int timer_fd = -1;
+
+/* Timer fd is armed once all expired timers have been called back */
+static bool expiring = false;
+
+/* Final part of each wait spent busy-waiting instead of sleeping (ns) */
+static uint64_t spin = 0;
+
+static void timer_queue_set(int index, timer_entry_t *timer)
+{
+    queue[index] = timer;
+    timer->index = index;
+}
+
+static void timer_queue_up(int index)
+{
+    timer_entry_t *timer = queue[index];
+
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+
+        if (queue[parent]->deadline <= timer->deadline)
+        {
+            break;
+        }
+        timer_queue_set(index, queue[parent]);
+        index = parent;
+    }
+    timer_queue_set(index, timer);
+}
+
+static void timer_queue_down(int index)
+{
+    timer_entry_t *timer = queue[index];
+
+    while (1)
+    {
+        int child = 2 * index + 1;
+
+        if (child >= queue_count)
+        {
+            break;
+        }
+        if ((child + 1 < queue_count) && (queue[child + 1]->deadline < queue[child]->deadline))
+        {
+            child++;
+        }
+        if (timer->deadline <= queue[child]->deadline)
+        {
+            break;
+        }
+        timer_queue_set(index, queue[child]);
+        index = child;
+    }
+    timer_queue_set(index, timer);
+}
+
+/* Arm timer fd for earliest deadline or disarm it if no timers */
+static void timer_fd_arm(void)
+{
+    struct itimerspec spec;
+
+    if (expiring)
+    {
+        return;
+    }
+
+    memset(&spec, 0, sizeof(spec));
+
+    if (queue_count > 0)
+    {
+        /* Wake up early to spin if enabled. Zero would disarm timer - use
+         * earliest possible time instead. */
+        uint64_t deadline = (queue[0]->deadline > spin) ? queue[0]->deadline - spin : 1;
+
+        spec.it_value.tv_sec = deadline / 1000000000;
+        spec.it_value.tv_nsec = deadline % 1000000000;
+    }
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+    {
+        error_printf("timerfd_settime() failed (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Returns file descriptor which becomes readable when timers expire */
+int timers_init(void)
+{
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+    {
+        error_printf("timerfd_create() failed (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Room for timers of all devices - queue does not grow while running */
+    queue = malloc(TIMER_QUEUE_SIZE_MIN * sizeof(timer_entry_t *));
+    if (queue == NULL)
+    {
+        error_printf("Out of memory (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    queue_size = TIMER_QUEUE_SIZE_MIN;
+
+    return timer_fd;
+}
+
+/* Sleep-then-spin: wake up spin ns before a deadline and busy-wait for it.
+ * Trades CPU time for sub-millisecond accuracy. */
+void timers_spin_set(uint64_t ns)
+{
+    spin = ns;
+}
+
+void timer_init(timer_entry_t *timer, void (*callback)(timer_entry_t *timer), void *data)
+{
+    timer->deadline = 0;
+    timer->index = -1;
+    timer->callback = callback;
+    timer->data = data;
+}
+
+bool timer_scheduled(const timer_entry_t *timer)
+{
+    return timer->index >= 0;
+}
+
+/* Schedule timer to expire at deadline (CLOCK_MONOTONIC, ns). A scheduled
+ * timer is rescheduled. */
+void timer_schedule(timer_entry_t *timer, uint64_t deadline)
+{
+    timer_entry_t **new_queue;
+
+    if (timer_scheduled(timer))
+    {
+        timer_cancel(timer);
+    }
+
+    if (queue_count == queue_size)
+    {
+        int size = queue_size ? queue_size * 2 : TIMER_QUEUE_SIZE_MIN;
+
+        new_queue = realloc(queue, size * sizeof(timer_entry_t *));
+        if (new_queue == NULL)
+        {
+            error_printf("Out of memory (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        queue = new_queue;
+        queue_size = size;
+    }
+
+    timer->deadline = deadline;
+    timer_queue_set(queue_count++, timer);
+    timer_queue_up(timer->index);
+
+    if (queue[0] == timer)
+    {
+        timer_fd_arm();
+    }
+}
+
+void timer_cancel(timer_entry_t *timer)
+{
+    timer_entry_t *last;
+    int index = timer->index;
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    timer->index = -1;
+    queue_count--;
+
+    if (index != queue_count)
+    {
+        /* Move last timer into hole and restore heap order */
+        last = queue[queue_count];
+        timer_queue_set(index, last);
+        timer_queue_up(index);
+        timer_queue_down(last->index);
+    }
+
+    if (index == 0)
+    {
+        timer_fd_arm();
+    }
+}
+
+/* Call back expired timers (server loop) */
+void timers_expire(void)
+{
+    uint64_t expirations;
+    uint64_t now;
+    timer_entry_t *timer;
+
+    read(timer_fd, &expirations, sizeof(expirations));
+
+    now = event_time_now_ns();
+    expiring = true;
+
+    /* Woke up early to spin for earliest deadline */
+    if ((queue_count > 0) && (queue[0]->deadline > now) && (queue[0]->deadline - now <= spin))
+    {
+        while (now < queue[0]->deadline)
+        {
+            now = event_time_now_ns();
+        }
+    }
+
+    while ((queue_count > 0) && (queue[0]->deadline <= now))
+    {
+        timer = queue[0];
+        timer_cancel(timer);
+        timer->callback(timer);
+
+        /* Callbacks may take a while - catch up with timers that expired */
+        now = event_time_now_ns();
+    }
+
+    expiring = false;
+    timer_fd_arm();
+}
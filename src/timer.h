@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Longest busy-wait before a deadline (us) */
+#define TIMER_SPIN_US_MAX 1000
+
+/* Entry of timer queue. Expired entries are called back by the server loop
+ * one at a time, in order of deadline. */
+typedef struct timer_entry timer_entry_t;
+
+struct timer_entry
+{
+    uint64_t deadline;  // CLOCK_MONOTONIC (ns)
+    int index;          // Position in queue, -1 if not scheduled
+    void (*callback)(timer_entry_t *timer);
+    void *data;         // Passed on to callback via timer
+};
+
+int timers_init(void);
+void timers_spin_set(uint64_t ns);
+void timer_init(timer_entry_t *timer, void (*callback)(timer_entry_t *timer), void *data);
+void timer_schedule(timer_entry_t *timer, uint64_t deadline);
+void timer_cancel(timer_entry_t *timer);
+bool timer_scheduled(const timer_entry_t *timer);
+void timers_expire(void);
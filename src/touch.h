@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "device.h"
 
 typedef struct
 {
@@ -36,16 +37,11 @@ typedef struct
     uint8_t slots;
 } touch_start_data_t;
 
-int touch_create(int x, int y, int slots);
-void touch_destroy(void);
-bool touch_online(void);
-const char* touch_sys_name(void);
-void touch_tap(int x, int y, int duration);
-void do_touch_tap(void *message);
-void do_touch_tap_request(uint32_t x, uint32_t y, uint32_t duration);
+int touch_create(unsigned int id, int x_max, int y_max, int slots);
+void touch_down(input_device_t *touch, int x, int y);
+void touch_up(input_device_t *touch);
+int do_touch_tap(input_device_t *touch, void *message, uint32_t step, uint32_t *delay);
+int do_touch_tap_request(uint32_t x, uint32_t y, uint32_t duration);
 void do_touch_start(void *message);
-void do_touch_start_request(uint32_t x_max, uint32_t y_max, uint8_t slots);
-int touch_x_max(void);
-int touch_y_max(void);
-int touch_slots(void);
+int do_touch_start_request(uint32_t x_max, uint32_t y_max, uint8_t slots);
 
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/uinput.h>
+#include "uinput.h"
+#include "event.h"
+#include "print.h"
+#include "misc.h"
+
+#define DEV_INPUT_PATH "/dev/input"
+#define SYS_INPUT_PATH "/sys/devices/virtual/input"
+
+/* Find name of event device node (eventX) of input device in sysfs */
+static int uinput_event_name(const char *sys_name, char *name, size_t size)
+{
+    char path[PATH_MAX];
+    struct dirent *entry;
+    DIR *dir;
+    int status = -ENOENT;
+
+    snprintf(path, sizeof(path), "%s/%s", SYS_INPUT_PATH, sys_name);
+
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return -errno;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "event", 5) == 0)
+        {
+            snprintf(name, size, "%s", entry->d_name);
+            status = 0;
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    return status;
+}
+
+static bool uinput_node_exists(const char *name)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", DEV_INPUT_PATH, name);
+
+    return access(path, F_OK) == 0;
+}
+
+/* Wait for inotify to report creation of node or timeout */
+static int uinput_wait_node(int inotify_fd, const char *name)
+{
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    uint64_t deadline = event_time_now_ns() + UINPUT_CREATE_TIMEOUT_MS * 1000000ULL;
+    struct pollfd pfd = { .fd = inotify_fd, .events = POLLIN };
+    uint64_t now;
+    ssize_t length;
+
+    /* The node may have appeared before we started looking */
+    if (uinput_node_exists(name))
+    {
+        return 0;
+    }
+
+    while ((now = event_time_now_ns()) < deadline)
+    {
+        if (poll(&pfd, 1, (deadline - now + 999999) / 1000000) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + event->len)
+            {
+                event = (const struct inotify_event *) p;
+                if ((event->len > 0) && (strcmp(event->name, name) == 0))
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return -ETIMEDOUT;
+}
+
+/* Create configured uinput device and wait until its event device node
+ * shows up in /dev/input so that userspace can start listening to it. */
+int uinput_create(int fd, char *sys_name)
+{
+    char event_name[NAME_MAX + 1];
+    int inotify_fd;
+    int status;
+
+    /* Start watching before creating the device so no event is missed */
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ((inotify_fd >= 0) && (inotify_add_watch(inotify_fd, DEV_INPUT_PATH, IN_CREATE) < 0))
+    {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    if (ioctl(fd, UI_DEV_CREATE) < 0)
+    {
+        status = -errno;
+        error_printf("Could not create input device (%s)\n", strerror(-status));
+        goto out;
+    }
+
+    if (ioctl(fd, UI_GET_SYSNAME(SYS_NAME_LENGTH_MAX), sys_name) < 0)
+    {
+        status = -errno;
+        error_printf("Could not get input device name (%s)\n", strerror(-status));
+        goto out;
+    }
+
+    status = 0;
+
+    if (inotify_fd < 0)
+    {
+        warning_printf("Can not watch %s, not waiting for device node\n", DEV_INPUT_PATH);
+        goto out;
+    }
+
+    /* Created synchronously by UI_DEV_CREATE */
+    if (uinput_event_name(sys_name, event_name, sizeof(event_name)) < 0)
+    {
+        warning_printf("No event device found for %s\n", sys_name);
+        goto out;
+    }
+
+    if (uinput_wait_node(inotify_fd, event_name) < 0)
+    {
+        warning_printf("Timeout waiting for %s/%s\n", DEV_INPUT_PATH, event_name);
+    }
+    else
+    {
+        debug_printf("Device node %s/%s ready\n", DEV_INPUT_PATH, event_name);
+    }
+
+out:
+    if (inotify_fd >= 0)
+    {
+        close(inotify_fd);
+    }
+
+    return status;
+}
+
+/* Destroy uinput device. There is no way to tell when userspace has read
+ * the last events, so a device is only destroyed once a fixed grace period
+ * has passed since its last committed frame (commit_ns). The server loop is
+ * blocked for what remains of it. */
+void uinput_destroy(int fd, uint64_t commit_ns)
+{
+    uint64_t grace_end = commit_ns + UINPUT_DESTROY_GRACE_MS * 1000000ULL;
+    uint64_t now = event_time_now_ns();
+    struct timespec ts;
+
+    if (now < grace_end)
+    {
+        ts.tv_sec = (grace_end - now) / 1000000000ULL;
+        ts.tv_nsec = (grace_end - now) % 1000000000ULL;
+        while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR));
+    }
+
+    if (ioctl(fd, UI_DEV_DESTROY) < 0)
+    {
+        warning_printf("Could not destroy input device (%s)\n", strerror(errno));
+    }
+
+    close(fd);
+}
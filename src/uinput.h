@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2022-2023  Martin Lund
+ * Copyright (C) 2023  DEIF A/S
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Maximum time to wait for the event device node of a new device */
+#define UINPUT_CREATE_TIMEOUT_MS 1000
+
+/* Fixed grace period between last events of a device and its destruction */
+#define UINPUT_DESTROY_GRACE_MS 100
+
+int uinput_create(int fd, char *sys_name);
+void uinput_destroy(int fd, uint64_t commit_ns);
@@ -0,0 +1,24 @@
+#! /bin/bash
+
+# Batch test (script mode)
+#
+# Actions between 'batch begin' and 'batch end' are sent as a single request
+# and performed in order by the service. 'sleep' adds a delay to the batch.
+
+ie=input-emulator
+
+${ie} start --type-delay 0 kbd mouse
+${ie} status
+
+for (( c=1; c<=100; c++ ))
+do
+   echo "batch begin"
+   echo "kbd key a"
+   echo "sleep 0.01"
+   echo "mouse move 10 10"
+   echo "mouse button left"
+   echo "kbd key b"
+   echo "batch end"
+done | ${ie} run -
+
+${ie} stop all
@@ -0,0 +1,18 @@
+#! /bin/bash
+
+# Keyboard stress test (script mode)
+
+ie=input-emulator
+
+${ie} start --type-delay 0 kbd
+${ie} status
+
+for (( c=1; c<=1000; c++ ))
+do
+   echo "kbd key a"
+   echo "kbd key b"
+   echo "kbd key c"
+   echo "kbd type \"123\""
+done | ${ie} run -
+
+${ie} stop kbd
@@ -0,0 +1,31 @@
+#! /bin/bash
+
+# Command line options test
+#
+# Options of a command may be given before or after its non-option arguments,
+# also when global options such as --instance precede the command.
+
+ie=input-emulator
+
+check()
+{
+    if ! "$@"
+    then
+        echo "Failed: $*"
+        exit 1
+    fi
+}
+
+check ${ie} start mouse --x-max 1920 --y-max 1080
+check ${ie} status
+check ${ie} stop all
+
+check ${ie} start --type-delay 0 kbd --layout us
+check ${ie} kbd -i 0 key a
+check ${ie} stop -i 0 kbd
+
+check ${ie} --instance options-test start kbd --type-delay 0
+check ${ie} --instance options-test kbd key a
+check ${ie} --instance options-test stop all
+
+echo "Passed"
@@ -0,0 +1,24 @@
+#! /bin/bash
+
+# Socket activation test
+#
+# systemd-socket-activate binds the service socket and starts the service on
+# the first connection, passing the listening socket via LISTEN_FDS.
+
+ie=input-emulator
+
+systemd-socket-activate -l @input-emulator.socket ${ie} start --no-daemonize --type-delay 0 kbd &
+activate_pid=$!
+sleep 0.5
+
+# First request starts the service
+${ie} status
+
+for (( c=1; c<=100; c++ ))
+do
+   ${ie} kbd key a
+done
+
+${ie} stop kbd
+
+wait ${activate_pid}